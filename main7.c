@@ -10,6 +10,25 @@
 #include <allegro5/allegro_ttf.h>
 #include <stdarg.h>
 #include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#ifdef STL_VIEWER_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef STL_VIEWER_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -20,33 +39,186 @@
 #define FPS 60.0
 #define MODEL_VIEW_SIZE 150.0f
 #define MOUSE_SENSITIVITY 0.005f
+#define PICK_CLICK_SLOP 3 // Max pixels the mouse may move between press and release for a click to pick
 #define LOG_FILE "stl_viewer.log"
+#define STL_BINARY_HEADER_SIZE 84 // 80-byte header + uint32 facet count
+#define STL_BINARY_FACET_SIZE 50  // normal[3], vertex[3][3] (float32) + uint16 attribute
 #define DEFAULT_STL_PATH "C:/Users/User/source/repos/p{]pfinal project/my_model.stl"
 
 FILE* g_log_file = NULL;
 
 // --- Logging Function (app_log) ---
-void app_log(bool also_to_console, const char* prefix, const char* format, ...) {
+// app_log() formats on the calling thread and pushes the message into a bounded lock-free ring (Vyukov's MPMC queue).
+// Once log_start_writer() has run, a background thread drains it, stamps lines with a timestamp cached per second,
+// and only flushes the file after WARN/ERROR/FATAL lines or at shutdown. Before the writer starts (and after it
+// stops) messages are written synchronously. Messages below STL_VIEWER_LOG_COMPILE_LEVEL compile away; --log-level
+// raises the threshold at runtime.
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_FATAL 4
+#ifndef STL_VIEWER_LOG_COMPILE_LEVEL
+#define STL_VIEWER_LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+#define LOG_RING_SLOTS 4096 // Power of two
+#define LOG_MESSAGE_MAX 512 // Longer messages are truncated
+#define LOG_WRITER_IDLE_SECONDS 0.01
+
+// Level of a prefix literal ("DEBUG", "INFO", ...). Constant for literals, so filtered calls are dropped at compile time.
+#define LOG_PREFIX_LEVEL(prefix) ((prefix)[0] == 'D' ? LOG_LEVEL_DEBUG : (prefix)[0] == 'I' ? LOG_LEVEL_INFO : \
+    (prefix)[0] == 'W' ? LOG_LEVEL_WARN : (prefix)[0] == 'E' ? LOG_LEVEL_ERROR : LOG_LEVEL_FATAL)
+#define app_log(also_to_console, prefix, ...) do { \
+    if (LOG_PREFIX_LEVEL(prefix) >= STL_VIEWER_LOG_COMPILE_LEVEL && LOG_PREFIX_LEVEL(prefix) >= g_log_level) \
+        app_log_message(also_to_console, prefix, __VA_ARGS__); \
+} while (0)
+
+#if defined(_MSC_VER)
+static int64_t log_atomic_load(volatile int64_t* p) { return InterlockedCompareExchange64((volatile LONG64*)p, 0, 0); }
+static void log_atomic_store(volatile int64_t* p, int64_t v) { InterlockedExchange64((volatile LONG64*)p, v); }
+static bool log_atomic_cas(volatile int64_t* p, int64_t expected, int64_t desired) { return InterlockedCompareExchange64((volatile LONG64*)p, desired, expected) == expected; }
+static void log_atomic_add(volatile int64_t* p, int64_t v) { InterlockedExchangeAdd64((volatile LONG64*)p, v); }
+#else
+static int64_t log_atomic_load(volatile int64_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static void log_atomic_store(volatile int64_t* p, int64_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static bool log_atomic_cas(volatile int64_t* p, int64_t expected, int64_t desired) { return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED); }
+static void log_atomic_add(volatile int64_t* p, int64_t v) { __atomic_fetch_add(p, v, __ATOMIC_RELAXED); }
+#endif
+
+typedef struct {
+    volatile int64_t sequence; // Equals the slot's ticket when free, ticket + 1 once a message is published
+    time_t time;
+    char prefix[8];
+    bool to_console;
+    char text[LOG_MESSAGE_MAX];
+} LogRecord;
+
+typedef struct {
+    LogRecord slots[LOG_RING_SLOTS];
+    volatile int64_t enqueue_pos;
+    int64_t dequeue_pos;       // Only touched by the writer
+    volatile int64_t dropped;  // Messages lost because the ring was full
+    volatile int64_t running;  // Nonzero while the writer thread owns the file
+    ALLEGRO_THREAD* writer;
+    time_t stamp_time;         // Writer-side timestamp cache
+    char stamp[32];
+} LogRing;
+
+int g_log_level = LOG_LEVEL_DEBUG; // --log-level
+bool g_log_console_stderr = false; // All console output goes to stderr, keeping stdout for the benchmark report
+static LogRing g_log_ring;
+
+static int log_level_from_name(const char* name) {
+    if (strcmp(name, "debug") == 0) return LOG_LEVEL_DEBUG;
+    if (strcmp(name, "info") == 0) return LOG_LEVEL_INFO;
+    if (strcmp(name, "warn") == 0) return LOG_LEVEL_WARN;
+    if (strcmp(name, "error") == 0) return LOG_LEVEL_ERROR;
+    return -1;
+}
+
+// Returns true when the line should be flushed to disk (WARN and above).
+static bool log_write_line(const char* prefix, bool to_console, const char* text, const char* stamp) {
+    if (g_log_file) fprintf(g_log_file, "[%s] [%s] %s\n", stamp, prefix, text);
+    if (to_console) {
+        if (LOG_PREFIX_LEVEL(prefix) >= LOG_LEVEL_WARN || g_log_console_stderr) fprintf(stderr, "[%s] %s\n", prefix, text);
+        else printf("[%s] %s\n", prefix, text);
+    }
+    return LOG_PREFIX_LEVEL(prefix) >= LOG_LEVEL_WARN;
+}
+
+static void format_log_timestamp(time_t when, char* stamp, size_t stamp_size) {
+    strftime(stamp, stamp_size, "%Y-%m-%d %H:%M:%S", localtime(&when));
+}
+
+// Writes every published record, flushing once at the end if any of them was WARN or above. Returns the number written.
+static int log_drain(LogRing* ring) {
+    int written = 0; bool flush = false;
+    for (;;) {
+        LogRecord* slot = &ring->slots[ring->dequeue_pos & (LOG_RING_SLOTS - 1)];
+        if (log_atomic_load(&slot->sequence) != ring->dequeue_pos + 1) break;
+        if (slot->time != ring->stamp_time) { ring->stamp_time = slot->time; format_log_timestamp(slot->time, ring->stamp, sizeof(ring->stamp)); }
+        flush |= log_write_line(slot->prefix, slot->to_console, slot->text, ring->stamp);
+        log_atomic_store(&slot->sequence, ring->dequeue_pos + LOG_RING_SLOTS);
+        ring->dequeue_pos++; written++;
+    }
+    int64_t dropped = log_atomic_load(&ring->dropped);
+    if (dropped > 0) {
+        log_atomic_add(&ring->dropped, -dropped);
+        char text[96]; snprintf(text, sizeof(text), "Log ring full; dropped %lld messages.", (long long)dropped);
+        time_t now = time(NULL); char stamp[32]; format_log_timestamp(now, stamp, sizeof(stamp));
+        flush |= log_write_line("WARN", false, text, stamp);
+    }
+    if (flush && g_log_file) fflush(g_log_file);
+    return written;
+}
+
+static void* log_writer_thread_proc(ALLEGRO_THREAD* thread, void* arg) {
+    LogRing* ring = (LogRing*)arg;
+    while (!al_get_thread_should_stop(thread)) {
+        if (log_drain(ring) == 0) al_rest(LOG_WRITER_IDLE_SECONDS);
+    }
+    log_drain(ring);
+    return NULL;
+}
+
+void app_log_message(bool also_to_console, const char* prefix, const char* format, ...) {
     if (!g_log_file && strcmp(prefix, "FATAL") != 0) {
         if (also_to_console) {
             va_list args_console; va_start(args_console, format);
-            if (strcmp(prefix, "ERROR") == 0 || strcmp(prefix, "WARN") == 0 || strcmp(prefix, "FATAL") == 0) {
+            if (strcmp(prefix, "ERROR") == 0 || strcmp(prefix, "WARN") == 0 || strcmp(prefix, "FATAL") == 0 || g_log_console_stderr) {
                 fprintf(stderr, "[NO_LOG_FILE] [%s] ", prefix); vfprintf(stderr, format, args_console); fprintf(stderr, "\n");
             }
             else { printf("[NO_LOG_FILE] [%s] ", prefix); vprintf(format, args_console); printf("\n"); }
             va_end(args_console);
         } return;
     }
-    char buffer[2048]; char timestamp[64]; va_list args;
-    time_t now = time(NULL); strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    va_start(args, format); vsnprintf(buffer, sizeof(buffer), format, args); va_end(args);
-    if (g_log_file) { fprintf(g_log_file, "[%s] [%s] %s\n", timestamp, prefix, buffer); fflush(g_log_file); }
-    if (also_to_console) {
-        if (strcmp(prefix, "ERROR") == 0 || strcmp(prefix, "WARN") == 0 || strcmp(prefix, "FATAL") == 0) {
-            fprintf(stderr, "[%s] %s\n", prefix, buffer);
+    LogRing* ring = &g_log_ring; va_list args;
+    if (!log_atomic_load(&ring->running)) { // No writer thread: write synchronously
+        char buffer[LOG_MESSAGE_MAX]; char timestamp[32];
+        va_start(args, format); vsnprintf(buffer, sizeof(buffer), format, args); va_end(args);
+        time_t now = time(NULL); format_log_timestamp(now, timestamp, sizeof(timestamp));
+        if (log_write_line(prefix, also_to_console, buffer, timestamp) && g_log_file) fflush(g_log_file);
+        return;
+    }
+    int64_t pos = log_atomic_load(&ring->enqueue_pos); LogRecord* slot;
+    for (;;) {
+        slot = &ring->slots[pos & (LOG_RING_SLOTS - 1)];
+        int64_t diff = log_atomic_load(&slot->sequence) - pos;
+        if (diff == 0) { if (log_atomic_cas(&ring->enqueue_pos, pos, pos + 1)) break; pos = log_atomic_load(&ring->enqueue_pos); }
+        else if (diff < 0) { // Full: DEBUG/INFO are dropped (and counted); WARN and above wait for the writer
+            if (LOG_PREFIX_LEVEL(prefix) < LOG_LEVEL_WARN) { log_atomic_add(&ring->dropped, 1); return; }
+            al_rest(0.0); pos = log_atomic_load(&ring->enqueue_pos);
         }
-        else { printf("[%s] %s\n", prefix, buffer); }
+        else pos = log_atomic_load(&ring->enqueue_pos);
+    }
+    slot->time = time(NULL); slot->to_console = also_to_console;
+    snprintf(slot->prefix, sizeof(slot->prefix), "%s", prefix);
+    va_start(args, format); vsnprintf(slot->text, sizeof(slot->text), format, args); va_end(args);
+    log_atomic_store(&slot->sequence, pos + 1);
+}
+
+// Hands the log file to a background writer. Needs Allegro initialized.
+static void log_start_writer(void) {
+    LogRing* ring = &g_log_ring;
+    if (!g_log_file || ring->writer) return;
+    for (int64_t i = 0; i < LOG_RING_SLOTS; ++i) ring->slots[i].sequence = i;
+    ring->enqueue_pos = 0; ring->dequeue_pos = 0; ring->dropped = 0; ring->stamp_time = (time_t)-1;
+    ring->writer = al_create_thread(log_writer_thread_proc, ring);
+    if (!ring->writer) { app_log(true, "WARN", "Failed to start the log writer thread; logging synchronously."); return; }
+    log_atomic_store(&ring->running, 1);
+    al_start_thread(ring->writer);
+}
+
+// Writes out everything still queued, stops the writer and closes the log file.
+static void close_log(void) {
+    LogRing* ring = &g_log_ring;
+    if (ring->writer) {
+        al_join_thread(ring->writer, NULL); // Sets should_stop; the thread drains once more before exiting
+        al_destroy_thread(ring->writer); ring->writer = NULL;
+        log_atomic_store(&ring->running, 0);
+        log_drain(ring); // Anything published after the writer's last pass
     }
+    if (g_log_file) { fflush(g_log_file); fclose(g_log_file); g_log_file = NULL; }
 }
 
 // --- Structure Definitions (Order is Important!) ---
@@ -55,34 +227,158 @@ typedef struct {
 } Point3D; // For general 3D points/vectors not needing color
 
 typedef struct {
-    float x, y, z;
-    ALLEGRO_COLOR color; // Color for this vertex (for gradient)
-} Vertex; // For model vertices that store color
+    float* x; // Structure-of-arrays model positions: vertex i is (x[i], y[i], z[i])
+    float* y;
+    float* z;
+} VertexPositions;
+
+typedef struct {
+    int16_t* x; // --compact model positions: fixed point, POSITION_QUANT_STEP view units per step
+    int16_t* y;
+    int16_t* z;
+} QuantizedPositions;
 
 typedef struct {
     int v_idx[3];
-    float avg_z;
-    Point3D normal; // Face normal uses Point3D
+    Point3D normal; // Unit normal in object space, computed once at load from the vertex winding
 } Face;
 
+typedef struct {
+    float center[3], radius; // Bounding sphere of the corners, object space
+    float cone_axis[3];      // Unit average of the face normals
+    float cone_cutoff;       // Sine of the cone's half angle (plus slack), or MESHLET_NO_CONE
+    int first_face, face_count;     // Contiguous range in faces[]
+    int first_vertex, vertex_count; // Vertex index range covering every corner of those faces
+} Meshlet;
+
+typedef struct {
+    float center[3], radius;          // Encloses the spheres of its meshlets; radius < 0 when none has a face to draw
+    int first_meshlet, meshlet_count; // Contiguous range of meshlets[]; a leaf holds one
+    int skip;                         // Index of the next node after this subtree (preorder)
+} MeshletNode;
+
+typedef struct {
+    VertexPositions original;    // Normalized object-space positions
+    VertexPositions transformed; // Projected copy, rewritten every rendered frame
+    uint32_t* colors; // Packed RGBA8
+    Face* faces;
+    int num_vertices;
+    int num_faces;
+    QuantizedPositions quantized; // Set instead of original.x for a --compact model
+    const Meshlet* meshlets;      // Face clusters, or NULL for the drag proxy and the load preview
+    int num_meshlets;
+    int* visible_meshlets;        // Meshlets that survived culling this frame; filled by transform_render_mesh()
+    int num_visible_meshlets;
+    const MeshletNode* meshlet_nodes; // Sphere hierarchy over meshlets, or NULL to test every meshlet
+    int num_meshlet_nodes;
+} RenderMesh; // What the renderers draw: the loaded model or its drag proxy
+
+typedef struct {
+    uint32_t key; // Sortable bit pattern of the face depth, inverted so farther faces sort first
+    int face;     // Index into faces[]
+} DepthKey;
+
+typedef struct {
+    float min[3], max[3];
+    int first; // Leaf: first entry in bvh_face_index. Interior: index of the left child, the right one follows it
+    int count; // Faces in a leaf, 0 for interior nodes
+} BvhNode;
+
 typedef struct {
     float w, x, y, z;
 } Quaternion;
 
+typedef struct {
+    float zmin, zmax; // Object-space Z extent of the face
+    int face;
+} SliceInterval;
+
+typedef struct {
+    float center;      // Every interval of the node contains it; lower ones are in left, higher ones in right
+    int left, right;   // Child nodes, or -1
+    int first, count;  // Same range of g_slice_by_min (ascending zmin) and g_slice_by_max (descending zmax)
+} SliceNode;
+
+// Mesh validation flags, per face (see validate_mesh())
+enum {
+    VALIDATE_OPEN_EDGE = 1,     // Face has an edge no other face shares
+    VALIDATE_NON_MANIFOLD = 2,  // Face has an edge shared by three or more faces
+    VALIDATE_WINDING = 4,       // Face runs an edge in the same direction as its neighbor
+    VALIDATE_DUPLICATE = 8,     // Another face has the same three corners
+    VALIDATE_DEGENERATE = 16,   // Zero area (STATS_DEGENERATE_SINE), collapsed or non-finite corners
+    VALIDATE_DRAW_EDGE = 64,    // Half-edge: draw it (one per open or non-manifold edge)
+    VALIDATE_SKIP = 128         // Face: collapsed or invalid, left out of the edge and duplicate passes
+};
+
 // --- Global Variables ---
-Vertex* original_vertices = NULL;
-Vertex* transformed_vertices = NULL;
+VertexPositions original_positions = { NULL, NULL, NULL };
+QuantizedPositions quantized_positions = { NULL, NULL, NULL }; // Replaces original_positions once a --compact model is loaded
+VertexPositions transformed_positions = { NULL, NULL, NULL };
+uint32_t* vertex_colors = NULL; // Gradient color per vertex, packed RGBA8
 Face* faces = NULL;
 int num_vertices = 0;
 int num_faces = 0;
 
+DepthKey* depth_keys = NULL;         // Painter order, rebuilt every frame
+DepthKey* depth_keys_scratch = NULL; // Ping-pong buffer for the radix passes
+int depth_key_capacity = 0;
+
+int* g_visible_meshlets = NULL; // Per-frame meshlet culling output; one block shared with g_transform_spans
+int* g_transform_spans = NULL;  // [begin, end) vertex ranges of the visible meshlets
+int g_meshlet_frame_capacity = 0;
+
+ALLEGRO_VERTEX* draw_vertices = NULL;              // Shaded triangles for the whole frame
+int draw_vertex_capacity = 0;
+ALLEGRO_VERTEX_BUFFER* draw_vertex_buffer = NULL;  // GPU-side copy when the driver supports it
+int draw_vertex_buffer_capacity = 0;
+bool draw_vertex_buffer_unsupported = false;
+bool draw_vertex_buffer_locked = false;
+
 Point3D light_direction; // Uses Point3D
 float ambient_light_intensity = 0.3f;
 float diffuse_light_intensity = 0.7f;
 
+bool g_weld_vertices = false; // --weld: merge shared corners into an indexed mesh at load time
+bool g_compact_positions = false; // --compact: welded mesh with 16-bit positions
+bool g_backface_culling = true; // Toggled with B; off helps with meshes whose winding is inconsistent
+
 bool is_dragging = false;
+bool is_panning = false; // Right button held; also draws the drag proxy
 int last_mouse_x = 0;
 int last_mouse_y = 0;
+int press_mouse_x = 0; // Where the left button went down; a release close to it is a pick, not a drag
+int press_mouse_y = 0;
+
+BvhNode* bvh_nodes = NULL;  // Picking hierarchy over faces, built at load
+int* bvh_face_index = NULL; // Face indices grouped by leaf
+int bvh_node_count = 0;
+Meshlet* meshlets = NULL;   // Face clusters in faces[] order, built at load
+int num_meshlets = 0;
+MeshletNode* meshlet_nodes = NULL; // Built from meshlets[] after every load, cached or not
+int num_meshlet_nodes = 0;
+Point3D g_model_center = { 0, 0, 0 }; // Normalization applied at load: view = (model - center) * scale
+float g_model_scale = 1.0f;
+int g_picked_face = -1;
+Point3D g_picked_point; // Hit position in model units
+float g_picked_area = 0.0f;
+uint8_t* g_face_issues = NULL; // Per-face VALIDATE_* flags once the mesh has been validated (V)
+int* g_issue_faces = NULL;     // Faces with any issue, for the overlay
+int g_num_issue_faces = 0;
+int* g_issue_edges = NULL;     // Half-edges (face * 3 + corner) drawn as open or, complemented, non-manifold edges
+int g_num_issue_edges = 0;
+bool g_mesh_validated = false;
+bool g_show_validation = false;
+SliceNode* g_slice_nodes = NULL; // Interval tree over the faces' Z extents, built the first time slicing is turned on (S)
+SliceInterval* g_slice_by_min = NULL;
+SliceInterval* g_slice_by_max = NULL;
+int g_slice_root = -1;
+float g_slice_zmin = 0.0f, g_slice_zmax = 0.0f; // Z range of the faces, object space
+float g_slice_z = 0.0f;                         // Current plane, object space
+Point3D* g_slice_points = NULL;   // Cut outline: polyline i is g_slice_points[g_slice_polylines[i] .. g_slice_polylines[i + 1])
+int* g_slice_polylines = NULL;
+int g_num_slice_polylines = 0;
+int g_num_slice_closed = 0;       // Polylines that end where they started
+bool g_show_slice = false;
 
 Quaternion g_orientation; // Global orientation quaternion
 
@@ -115,318 +411,4733 @@ void quaternion_to_rotation_matrix(Quaternion q, float matrix[3][3]) {
     matrix[1][0] = 2.0f * (xy + zw); matrix[1][1] = 1.0f - 2.0f * (xx + zz); matrix[1][2] = 2.0f * (yz - xw);
     matrix[2][0] = 2.0f * (xz - yw); matrix[2][1] = 2.0f * (yz + xw); matrix[2][2] = 1.0f - 2.0f * (xx + yy);
 }
-// Apply matrix to Vertex (only coords, color is preserved)
-Vertex apply_rotation_matrix_to_vertex(float matrix[3][3], Vertex v_orig) {
-    Vertex result;
-    result.x = matrix[0][0] * v_orig.x + matrix[0][1] * v_orig.y + matrix[0][2] * v_orig.z;
-    result.y = matrix[1][0] * v_orig.x + matrix[1][1] * v_orig.y + matrix[1][2] * v_orig.z;
-    result.z = matrix[2][0] * v_orig.x + matrix[2][1] * v_orig.y + matrix[2][2] * v_orig.z;
-    result.color = v_orig.color;
-    return result;
+
+// --- Camera ---
+// The view orbits g_camera.pivot, which stays at the screen center: q = R (p - pivot) with x right, y up and z away
+// from the viewer. Orthographic: screen offset = zoom * q.xy and depth = q.z. Perspective: the eye sits
+// CAMERA_EYE_DISTANCE (D) in front of the pivot, screen offset = f * q.xy / (q.z + D) with f = zoom * D, and depth is
+// -1 / (q.z + D), which still grows with distance and, unlike the distance itself, interpolates linearly across the
+// screen. Zooming narrows the field of view instead of moving the eye, and the pivot stays inside the model cube, so
+// every vertex is at least D - sqrt(3) * MODEL_VIEW_SIZE in front of the eye and nothing needs near-plane clipping.
+#define CAMERA_EYE_DISTANCE (3.0f * MODEL_VIEW_SIZE)
+#define CAMERA_MIN_ZOOM 0.1f
+#define CAMERA_MAX_ZOOM 1000.0f
+#define CAMERA_WHEEL_STEP 1.2f // Zoom factor per mouse wheel notch
+
+typedef struct {
+    bool perspective; // Toggled with P
+    float zoom;       // Screen pixels per view unit at the pivot's depth; mouse wheel
+    Point3D pivot;    // Object-space point at the screen center; right-drag pans it
+} Camera;
+
+Camera g_camera = { false, 1.0f, { 0, 0, 0 } };
+
+typedef struct {
+    float m[3][3], t[3];  // Affine part: rows 0-1 in screen pixels before any divide, row 2 the view depth (+ D)
+    bool perspective;     // x and y are divided by row 2, which is then replaced by -1/row 2
+    float rotation[3][3]; // Plain object-to-view rotation
+    float scale;          // zoom (orthographic) or focal length in pixels (perspective)
+    Point3D pivot, eye;   // Object space; eye only in perspective
+    float edge_scale[2];  // Turns the x/y screen-edge test values into view-space distances
+} ViewTransform;
+
+// The transform for the current camera looking at the model in the given orientation.
+static ViewTransform camera_view(Quaternion orientation) {
+    ViewTransform v; memset(&v, 0, sizeof(v));
+    quaternion_to_rotation_matrix(orientation, v.rotation);
+    v.perspective = g_camera.perspective;
+    v.scale = g_camera.perspective ? g_camera.zoom * CAMERA_EYE_DISTANCE : g_camera.zoom;
+    v.pivot = g_camera.pivot;
+    for (int r = 0; r < 3; ++r) {
+        float s = r < 2 ? v.scale : 1.0f;
+        for (int c = 0; c < 3; ++c) v.m[r][c] = v.rotation[r][c] * s;
+        v.t[r] = -(v.m[r][0] * v.pivot.x + v.m[r][1] * v.pivot.y + v.m[r][2] * v.pivot.z);
+    }
+    if (v.perspective) {
+        v.t[2] += CAMERA_EYE_DISTANCE;
+        v.eye = (Point3D){ v.pivot.x - CAMERA_EYE_DISTANCE * v.rotation[2][0], v.pivot.y - CAMERA_EYE_DISTANCE * v.rotation[2][1], v.pivot.z - CAMERA_EYE_DISTANCE * v.rotation[2][2] };
+        float kx = SCREEN_W / 2.0f / v.scale, ky = SCREEN_H / 2.0f / v.scale; // Side planes |q.x| = kx * (q.z + D), likewise y
+        v.edge_scale[0] = 1.0f / (v.scale * sqrtf(1.0f + kx * kx)); v.edge_scale[1] = 1.0f / (v.scale * sqrtf(1.0f + ky * ky));
+    }
+    else v.edge_scale[0] = v.edge_scale[1] = 1.0f / v.scale;
+    return v;
+}
+
+// Screen offset from the center (x right, y up) and depth of an object-space point, exactly as the transform kernels compute them.
+static Point3D view_project(const ViewTransform* v, Point3D p) {
+    float x = v->m[0][0] * p.x + v->m[0][1] * p.y + v->m[0][2] * p.z + v->t[0];
+    float y = v->m[1][0] * p.x + v->m[1][1] * p.y + v->m[1][2] * p.z + v->t[1];
+    float z = v->m[2][0] * p.x + v->m[2][1] * p.y + v->m[2][2] * p.z + v->t[2];
+    if (v->perspective) { float w = 1.0f / z; return (Point3D){ x * w, y * w, -w }; }
+    return (Point3D){ x, y, z };
 }
 
+typedef enum { VIEW_OUTSIDE, VIEW_PARTIAL, VIEW_INSIDE } ViewOverlap;
 
-// --- Vector Math (using Point3D) ---
-static Point3D vec_subtract(Point3D a, Point3D b) { return (Point3D) { a.x - b.x, a.y - b.y, a.z - b.z }; }
-static Point3D vec_cross_product(Point3D a, Point3D b) { return (Point3D) { a.y* b.z - a.z * b.y, a.z* b.x - a.x * b.z, a.x* b.y - a.y * b.x }; }
-static float vec_dot_product(Point3D a, Point3D b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
-static float vec_magnitude(Point3D v_pt) { // Renamed param to avoid conflict if v is Vertex
-    return sqrtf(v_pt.x * v_pt.x + v_pt.y * v_pt.y + v_pt.z * v_pt.z);
+// Where an object-space sphere lies relative to the four planes through the screen edges. There are no near or far
+// planes (see above); NaNs count as partial.
+static ViewOverlap view_test_sphere(const ViewTransform* v, const float center[3], float radius) {
+    float x = v->m[0][0] * center[0] + v->m[0][1] * center[1] + v->m[0][2] * center[2] + v->t[0];
+    float y = v->m[1][0] * center[0] + v->m[1][1] * center[1] + v->m[1][2] * center[2] + v->t[1];
+    float w = v->perspective ? v->m[2][0] * center[0] + v->m[2][1] * center[1] + v->m[2][2] * center[2] + v->t[2] : 1.0f;
+    float dx = (fabsf(x) - SCREEN_W / 2.0f * w) * v->edge_scale[0]; // Signed distance past the nearer side plane
+    float dy = (fabsf(y) - SCREEN_H / 2.0f * w) * v->edge_scale[1];
+    if (dx > radius || dy > radius) return VIEW_OUTSIDE;
+    if (dx < -radius && dy < -radius) return VIEW_INSIDE;
+    return VIEW_PARTIAL;
 }
-static Point3D vec_normalize(Point3D v_pt) { // Renamed param
-    float mag = vec_magnitude(v_pt);
-    if (mag == 0.0f || isnan(mag) || isinf(mag)) return (Point3D) { 0, 0, 0 };
-    return (Point3D) { v_pt.x / mag, v_pt.y / mag, v_pt.z / mag };
+
+// Object-space ray through window pixel (mouse_x, mouse_y), starting in front of everything.
+static void view_ray(const ViewTransform* v, int mouse_x, int mouse_y, float origin[3], float dir[3]) {
+    float sx = (mouse_x + 0.5f - SCREEN_W / 2.0f) / v->scale, sy = -(mouse_y + 0.5f - SCREEN_H / 2.0f) / v->scale;
+    float view_origin[3] = { sx, sy, -2.0f * MODEL_VIEW_SIZE }, view_dir[3] = { 0.0f, 0.0f, 1.0f };
+    if (v->perspective) { view_origin[0] = view_origin[1] = 0.0f; view_origin[2] = -CAMERA_EYE_DISTANCE; view_dir[0] = sx; view_dir[1] = sy; }
+    const float pivot[3] = { v->pivot.x, v->pivot.y, v->pivot.z };
+    for (int a = 0; a < 3; ++a) { // Back to object space through the transpose (inverse) of the rotation
+        origin[a] = pivot[a] + v->rotation[0][a] * view_origin[0] + v->rotation[1][a] * view_origin[1] + v->rotation[2][a] * view_origin[2];
+        dir[a] = v->rotation[0][a] * view_dir[0] + v->rotation[1][a] * view_dir[1] + v->rotation[2][a] * view_dir[2];
+    }
 }
 
-// --- Color Interpolation ---
-float lerp(float a, float b, float t) { return a + t * (b - a); }
-ALLEGRO_COLOR color_lerp(ALLEGRO_COLOR c1, ALLEGRO_COLOR c2, float t) {
-    float r1, g1, b1, a1; float r2, g2, b2, a2;
-    al_unmap_rgba_f(c1, &r1, &g1, &b1, &a1); al_unmap_rgba_f(c2, &r2, &g2, &b2, &a2);
-    return al_map_rgba_f(lerp(r1, r2, t), lerp(g1, g2, t), lerp(b1, b2, t), lerp(a1, a2, t));
+// Moves the pivot by a view-space offset (x right, y up) and keeps it inside the model cube.
+static void camera_move_pivot(Quaternion orientation, float view_dx, float view_dy) {
+    float r[3][3]; quaternion_to_rotation_matrix(orientation, r);
+    float* p[3] = { &g_camera.pivot.x, &g_camera.pivot.y, &g_camera.pivot.z };
+    for (int a = 0; a < 3; ++a) *p[a] = fminf(MODEL_VIEW_SIZE / 2.0f, fmaxf(-MODEL_VIEW_SIZE / 2.0f, *p[a] + r[0][a] * view_dx + r[1][a] * view_dy));
 }
 
+// Right-drag: the model follows the cursor by (dx, dy) window pixels.
+static void camera_pan(Quaternion orientation, int dx, int dy) {
+    camera_move_pivot(orientation, -dx / g_camera.zoom, dy / g_camera.zoom);
+}
 
-static void cleanup_model_data() {
-    app_log(false, "DEBUG", "Cleaning up model data.");
-    if (original_vertices) free(original_vertices);
-    if (transformed_vertices) free(transformed_vertices);
-    if (faces) free(faces);
-    original_vertices = NULL; transformed_vertices = NULL; faces = NULL;
-    num_vertices = 0; num_faces = 0;
+// Mouse wheel: scales the zoom and keeps the point under the cursor (at the pivot's depth) where it is.
+static void camera_zoom_at(Quaternion orientation, int mouse_x, int mouse_y, float factor) {
+    float old_zoom = g_camera.zoom;
+    g_camera.zoom = fminf(CAMERA_MAX_ZOOM, fmaxf(CAMERA_MIN_ZOOM, old_zoom * factor));
+    float k = 1.0f / old_zoom - 1.0f / g_camera.zoom; // The cursor sits s / zoom from the pivot in view units
+    camera_move_pivot(orientation, (mouse_x + 0.5f - SCREEN_W / 2.0f) * k, -(mouse_y + 0.5f - SCREEN_H / 2.0f) * k);
 }
 
-static bool load_stl_ascii(const char* filename) {
-    app_log(true, "INFO", "Attempting to load STL file: %s", filename);
-    FILE* file = fopen(filename, "r");
-    if (!file) { app_log(true, "ERROR", "Could not open STL file '%s'. Check path and permissions.", filename); return false; }
+static void camera_reset(void) { g_camera.zoom = 1.0f; g_camera.pivot = (Point3D){ 0, 0, 0 }; }
+
+// --- Worker Pool ---
+// A persistent set of Allegro threads that run parallel_for() jobs. The calling thread takes jobs too, and
+// nested or concurrent calls fall back to running serially on the caller so they can never deadlock.
+#define MAX_WORKER_THREADS 64
+typedef void (*ParallelJobFn)(void* context, int job_index);
+
+typedef struct {
+    ALLEGRO_THREAD* threads[MAX_WORKER_THREADS];
+    int thread_count;
+    ALLEGRO_MUTEX* mutex;
+    ALLEGRO_COND* work_cond;
+    ALLEGRO_COND* done_cond;
+    ParallelJobFn job_fn;
+    void* job_context;
+    int job_count, next_job, jobs_done;
+    unsigned int generation;
+    bool busy, shutting_down, initialized;
+} WorkerPool;
+
+static WorkerPool g_worker_pool;
 
-    char line[256]; int current_face_idx = 0; int current_vertex_idx = 0; num_faces = 0;
-    while (fgets(line, sizeof(line), file)) {
-        char* trimmed_line = line; while (*trimmed_line == ' ' || *trimmed_line == '\t') trimmed_line++;
-        if (strncmp(trimmed_line, "facet normal", 12) == 0) num_faces++;
+// Runs jobs of the current batch until none are left. Called and returns with the pool mutex held.
+static void worker_pool_drain_jobs(WorkerPool* pool) {
+    while (pool->next_job < pool->job_count) {
+        int job_index = pool->next_job++;
+        al_unlock_mutex(pool->mutex);
+        pool->job_fn(pool->job_context, job_index);
+        al_lock_mutex(pool->mutex);
+        if (++pool->jobs_done == pool->job_count) al_broadcast_cond(pool->done_cond);
     }
-    if (num_faces == 0) { app_log(true, "ERROR", "No facets found in STL file '%s'.", filename); fclose(file); return false; }
-    app_log(false, "DEBUG", "Found %d facets (first pass).", num_faces);
+}
 
-    num_vertices = num_faces * 3;
-    original_vertices = (Vertex*)malloc(num_vertices * sizeof(Vertex));
-    transformed_vertices = (Vertex*)malloc(num_vertices * sizeof(Vertex));
-    faces = (Face*)malloc(num_faces * sizeof(Face));
-    if (!original_vertices || !transformed_vertices || !faces) {
-        app_log(true, "ERROR", "Memory allocation failed for model data.", num_faces, num_vertices); // Corrected arg count
-        cleanup_model_data(); fclose(file); return false;
+static void* worker_pool_thread_proc(ALLEGRO_THREAD* thread, void* arg) {
+    (void)thread; WorkerPool* pool = (WorkerPool*)arg;
+    al_lock_mutex(pool->mutex);
+    unsigned int seen_generation = pool->generation;
+    while (true) {
+        while (!pool->shutting_down && pool->generation == seen_generation) al_wait_cond(pool->work_cond, pool->mutex);
+        if (pool->shutting_down) break;
+        seen_generation = pool->generation;
+        worker_pool_drain_jobs(pool);
     }
-    app_log(false, "DEBUG", "Memory allocated for %d vertices and %d faces.", num_vertices, num_faces);
+    al_unlock_mutex(pool->mutex);
+    return NULL;
+}
 
-    rewind(file);
-    Point3D min_coord_pt = { FLT_MAX,FLT_MAX,FLT_MAX }; // Use Point3D for these bounds
-    Point3D max_coord_pt = { -FLT_MAX,-FLT_MAX,-FLT_MAX };
-    current_face_idx = 0; current_vertex_idx = 0; int line_num = 0;
-
-    while (fgets(line, sizeof(line), file)) {
-        line_num++; char* trimmed_line = line;
-        while (*trimmed_line == ' ' || *trimmed_line == '\t' || *trimmed_line == '\r' || *trimmed_line == '\n') { if (*trimmed_line == '\0') break; trimmed_line++; }
-        if (*trimmed_line == '\0') continue;
-        if (strncmp(trimmed_line, "vertex", 6) == 0) {
-            if (current_vertex_idx < num_vertices) {
-                // Read into a temporary Point3D first, then assign to Vertex.x,y,z
-                Point3D temp_p;
-                int items_read = sscanf(trimmed_line, "vertex %f %f %f", &temp_p.x, &temp_p.y, &temp_p.z);
-                if (items_read == 3) {
-                    original_vertices[current_vertex_idx].x = temp_p.x;
-                    original_vertices[current_vertex_idx].y = temp_p.y;
-                    original_vertices[current_vertex_idx].z = temp_p.z;
-                    // original_vertices[current_vertex_idx].color will be set later
-
-                    if (temp_p.x < min_coord_pt.x) min_coord_pt.x = temp_p.x;
-                    if (temp_p.y < min_coord_pt.y) min_coord_pt.y = temp_p.y;
-                    if (temp_p.z < min_coord_pt.z) min_coord_pt.z = temp_p.z;
-                    if (temp_p.x > max_coord_pt.x) max_coord_pt.x = temp_p.x;
-                    if (temp_p.y > max_coord_pt.y) max_coord_pt.y = temp_p.y;
-                    if (temp_p.z > max_coord_pt.z) max_coord_pt.z = temp_p.z;
-                    current_vertex_idx++;
-                }
-                else { app_log(true, "WARN", "Line %d: Failed to parse 3 floats for vertex from: '%s'", line_num, trimmed_line); }
-            }
-            else { app_log(true, "WARN", "Line %d: Read more vertices than allocated (%d). Ignoring: '%s'", line_num, num_vertices, trimmed_line); }
-        }
-        else if (strncmp(trimmed_line, "endfacet", 8) == 0) {
-            if (current_face_idx < num_faces) {
-                if (current_vertex_idx >= (current_face_idx * 3) + 3) {
-                    faces[current_face_idx].v_idx[0] = (current_face_idx * 3) + 0;
-                    faces[current_face_idx].v_idx[1] = (current_face_idx * 3) + 1;
-                    faces[current_face_idx].v_idx[2] = (current_face_idx * 3) + 2;
-                }
-                else { app_log(true, "ERROR", "Line %d: Not enough vertices (%d) to form face %d. STL might be corrupt.", line_num, current_vertex_idx, current_face_idx); }
-                current_face_idx++;
-            }
-            else { app_log(true, "WARN", "Line %d: Read more 'endfacet' than counted. Ignoring.", line_num); }
-        }
+// Starts the pool threads. Call once from the main thread before any other thread that may use the pool exists;
+// until then parallel_for() runs serially.
+static void worker_pool_init(void) {
+    WorkerPool* pool = &g_worker_pool;
+    if (pool->initialized) return;
+    memset(pool, 0, sizeof(*pool));
+    pool->initialized = true;
+    pool->mutex = al_create_mutex(); pool->work_cond = al_create_cond(); pool->done_cond = al_create_cond();
+    if (!pool->mutex || !pool->work_cond || !pool->done_cond) { app_log(true, "WARN", "Worker pool unavailable. Running single-threaded."); return; }
+    int wanted = al_get_cpu_count() - 1; // The calling thread is the last worker
+    if (wanted > MAX_WORKER_THREADS) wanted = MAX_WORKER_THREADS;
+    for (int i = 0; i < wanted; ++i) {
+        ALLEGRO_THREAD* t = al_create_thread(worker_pool_thread_proc, pool);
+        if (!t) break;
+        pool->threads[pool->thread_count++] = t;
+        al_start_thread(t);
     }
-    fclose(file);
-    if (current_face_idx != num_faces) { app_log(true, "WARN", "Final face count mismatch. Expected %d, processed %d.", num_faces, current_face_idx); num_faces = current_face_idx; }
-    if (num_faces == 0) { app_log(true, "ERROR", "STL parsing resulted in zero valid faces."); cleanup_model_data(); return false; }
+    app_log(false, "DEBUG", "Worker pool started with %d threads.", pool->thread_count + 1);
+}
 
-    Point3D center_pt = { 0,0,0 }; float scale_factor = 1.0f; // Use Point3D for center
-    if (num_vertices > 0 && isfinite(min_coord_pt.x) && isfinite(max_coord_pt.x)) {
-        center_pt.x = (min_coord_pt.x + max_coord_pt.x) / 2.0f;
-        center_pt.y = (min_coord_pt.y + max_coord_pt.y) / 2.0f;
-        center_pt.z = (min_coord_pt.z + max_coord_pt.z) / 2.0f;
-        float extent_x = max_coord_pt.x - min_coord_pt.x; float extent_y = max_coord_pt.y - min_coord_pt.y; float extent_z = max_coord_pt.z - min_coord_pt.z;
-        float max_extent = fmaxf(extent_x, fmaxf(extent_y, extent_z));
-        if (max_extent > 1e-6f) scale_factor = MODEL_VIEW_SIZE / max_extent;
+static void worker_pool_shutdown(void) {
+    WorkerPool* pool = &g_worker_pool;
+    if (!pool->initialized) return;
+    if (pool->mutex) {
+        al_lock_mutex(pool->mutex); pool->shutting_down = true; al_broadcast_cond(pool->work_cond); al_unlock_mutex(pool->mutex);
     }
-    else if (num_vertices > 0) { app_log(true, "WARN", "Could not determine model bounds accurately."); }
+    for (int i = 0; i < pool->thread_count; ++i) { al_join_thread(pool->threads[i], NULL); al_destroy_thread(pool->threads[i]); }
+    if (pool->done_cond) al_destroy_cond(pool->done_cond);
+    if (pool->work_cond) al_destroy_cond(pool->work_cond);
+    if (pool->mutex) al_destroy_mutex(pool->mutex);
+    memset(pool, 0, sizeof(*pool));
+}
 
-    float min_y_orig = FLT_MAX; float max_y_orig = -FLT_MAX;
-    for (int i = 0; i < num_vertices; ++i) {
-        original_vertices[i].x = (original_vertices[i].x - center_pt.x) * scale_factor;
-        original_vertices[i].y = (original_vertices[i].y - center_pt.y) * scale_factor;
-        original_vertices[i].z = (original_vertices[i].z - center_pt.z) * scale_factor;
-        if (original_vertices[i].y < min_y_orig) min_y_orig = original_vertices[i].y;
-        if (original_vertices[i].y > max_y_orig) max_y_orig = original_vertices[i].y;
+// Total threads a parallel_for() can use, including the caller.
+static int worker_pool_size(void) { return g_worker_pool.thread_count + 1; }
+
+// Calls fn(context, i) for every i in [0, job_count) across the pool and returns when all of them finished.
+static void parallel_for(int job_count, ParallelJobFn fn, void* context) {
+    if (job_count <= 0) return;
+    WorkerPool* pool = &g_worker_pool;
+    bool run_serially = (job_count == 1 || pool->thread_count == 0);
+    if (!run_serially) {
+        al_lock_mutex(pool->mutex);
+        if (pool->busy) run_serially = true;
+        else {
+            pool->busy = true;
+            pool->job_fn = fn; pool->job_context = context;
+            pool->job_count = job_count; pool->next_job = 0; pool->jobs_done = 0;
+            pool->generation++;
+            al_broadcast_cond(pool->work_cond);
+            worker_pool_drain_jobs(pool);
+            while (pool->jobs_done < pool->job_count) al_wait_cond(pool->done_cond, pool->mutex);
+            pool->busy = false;
+        }
+        al_unlock_mutex(pool->mutex);
     }
+    if (run_serially) { for (int i = 0; i < job_count; ++i) fn(context, i); }
+}
 
-    ALLEGRO_COLOR color_bottom = al_map_rgb(0, 0, 255); ALLEGRO_COLOR color_top = al_map_rgb(0, 255, 0);
-    for (int i = 0; i < num_vertices; ++i) {
-        float t = 0.5f;
-        if ((max_y_orig - min_y_orig) > 1e-6f) { t = (original_vertices[i].y - min_y_orig) / (max_y_orig - min_y_orig); }
-        t = fminf(1.0f, fmaxf(0.0f, t));
-        original_vertices[i].color = color_lerp(color_bottom, color_top, t);
+// --- Vertex Position Arrays ---
+// x, y and z live in one allocation, each padded to a 64-byte multiple so the SIMD kernels see aligned rows.
+static int vertex_positions_stride(int count) { return (count + 15) & ~15; }
+
+static bool alloc_vertex_positions(VertexPositions* p, int count) {
+    size_t stride = (size_t)vertex_positions_stride(count > 0 ? count : 1);
+    float* block = (float*)malloc(stride * 3 * sizeof(float));
+    if (!block) { p->x = p->y = p->z = NULL; return false; }
+    p->x = block; p->y = block + stride; p->z = block + stride * 2;
+    return true;
+}
+
+static void free_vertex_positions(VertexPositions* p) {
+    if (p->x) free(p->x);
+    p->x = p->y = p->z = NULL;
+}
+
+// Makes room for at least needed vertices in p, which holds count of them and has room for *capacity.
+static bool grow_vertex_positions(VertexPositions* p, int count, int* capacity, int needed) {
+    if (needed <= *capacity) return true;
+    int new_capacity = *capacity > 0 ? *capacity : 1024;
+    while (new_capacity < needed) new_capacity = new_capacity > INT_MAX / 2 ? needed : new_capacity * 2;
+    VertexPositions grown;
+    if (!alloc_vertex_positions(&grown, new_capacity)) return false;
+    if (count > 0) {
+        memcpy(grown.x, p->x, (size_t)count * sizeof(float)); memcpy(grown.y, p->y, (size_t)count * sizeof(float)); memcpy(grown.z, p->z, (size_t)count * sizeof(float));
     }
-    app_log(false, "DEBUG", "Vertex colors calculated based on Y range [%.2f, %.2f]", min_y_orig, max_y_orig);
-    app_log(true, "INFO", "Successfully processed STL: %s, Faces: %d, Vertices: %d", filename, num_faces, num_vertices);
-    light_direction = vec_normalize((Point3D) { 0.5f, 0.5f, -1.0f });
+    free_vertex_positions(p);
+    *p = grown; *capacity = new_capacity;
     return true;
 }
-static int init_allegro() { /* ... same ... */
-    app_log(false, "DEBUG", "Initializing Allegro...");
-    if (!al_init()) { app_log(true, "ERROR", "Failed to initialize Allegro core!"); return -1; }
-    if (!al_install_keyboard()) { app_log(true, "ERROR", "Failed to initialize the keyboard!"); return -1; }
-    if (!al_install_mouse()) { app_log(true, "ERROR", "Failed to initialize the mouse!"); return -1; }
-    if (!al_init_primitives_addon()) { app_log(true, "ERROR", "Failed to initialize primitives addon!"); return -1; }
-    if (!al_init_font_addon()) { app_log(true, "WARN", "Failed to initialize font addon."); }
-    if (!al_init_ttf_addon()) { app_log(true, "WARN", "Failed to initialize ttf addon."); }
-    app_log(false, "DEBUG", "Allegro initialized successfully.");
-    return 0;
+
+// --compact keeps positions as int16 steps of POSITION_QUANT_STEP, which spans the normalized MODEL_VIEW_SIZE cube
+// with 65535 levels (about 0.002 view units, far below a pixel), in one allocation like the float arrays.
+#define POSITION_QUANT_STEP (MODEL_VIEW_SIZE / 65534.0f)
+
+static int16_t quantize_position(float v) {
+    float q = v * (1.0f / POSITION_QUANT_STEP);
+    q = q < -32767.0f ? -32767.0f : (q > 32767.0f ? 32767.0f : q);
+    return (int16_t)(q < 0.0f ? q - 0.5f : q + 0.5f);
 }
-int compare_faces(const void* a, const void* b) { /* ... same ... */
-    const Face* faceA = (const Face*)a; const Face* faceB = (const Face*)b;
-    if (faceA->avg_z < faceB->avg_z) return 1; if (faceA->avg_z > faceB->avg_z) return -1; return 0;
+
+static float dequantize_position(int16_t q) { return q * POSITION_QUANT_STEP; }
+
+static bool alloc_quantized_positions(QuantizedPositions* p, int count) {
+    size_t stride = (size_t)((count + 31) & ~31); // 64-byte rows
+    int16_t* block = (int16_t*)malloc((stride > 0 ? stride : 32) * 3 * sizeof(int16_t));
+    if (!block) { p->x = p->y = p->z = NULL; return false; }
+    p->x = block; p->y = block + stride; p->z = block + stride * 2;
+    return true;
 }
 
-int main(int argc, char** argv) {
-    g_log_file = fopen(LOG_FILE, "w");
-    if (!g_log_file) { app_log(true, "FATAL", "Could not open log file %s. Exiting.", LOG_FILE); return 1; }
-    app_log(true, "INFO", "Application started. Log file: %s", LOG_FILE);
-    g_orientation = quaternion_identity();
+static void free_quantized_positions(QuantizedPositions* p) {
+    if (p->x) free(p->x);
+    p->x = p->y = p->z = NULL;
+}
 
-    ALLEGRO_DISPLAY* display = NULL; ALLEGRO_EVENT_QUEUE* event_queue = NULL;
-    ALLEGRO_TIMER* timer = NULL; ALLEGRO_FONT* font = NULL;
+// --- Vertex Transform Kernels ---
+// Projects src[begin, end) into dst with a ViewTransform (see view_project()). Picked once at startup: AVX2+FMA, then
+// SSE, then plain C. The quantized variants read --compact positions and fold POSITION_QUANT_STEP into the matrix, so
+// dequantizing is just the int to float conversion in registers.
+typedef void (*TransformKernelFn)(const ViewTransform* v, const VertexPositions* src, VertexPositions* dst, int begin, int end);
+typedef void (*QuantizedTransformKernelFn)(const ViewTransform* v, const QuantizedPositions* src, VertexPositions* dst, int begin, int end);
 
-    const char* stl_filename = NULL;
-    if (argc < 2) {
-        stl_filename = DEFAULT_STL_PATH;
-        app_log(true, "INFO", "No command line argument for STL file. Using default: %s", stl_filename);
+static void transform_positions_scalar(const ViewTransform* v, const VertexPositions* src, VertexPositions* dst, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        Point3D p = view_project(v, (Point3D){ src->x[i], src->y[i], src->z[i] });
+        dst->x[i] = p.x; dst->y[i] = p.y; dst->z[i] = p.z;
     }
-    else {
-        stl_filename = argv[1];
-        app_log(false, "DEBUG", "STL filename from args: %s", stl_filename);
+}
+
+// v->m already includes POSITION_QUANT_STEP.
+static void transform_quantized_scalar(const ViewTransform* v, const QuantizedPositions* src, VertexPositions* dst, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        Point3D p = view_project(v, (Point3D){ (float)src->x[i], (float)src->y[i], (float)src->z[i] });
+        dst->x[i] = p.x; dst->y[i] = p.y; dst->z[i] = p.z;
     }
+}
 
-    if (init_allegro() != 0) { fclose(g_log_file); return -1; }
-    display = al_create_display(SCREEN_W, SCREEN_H);
-    if (!display) { app_log(true, "ERROR", "Failed to create display!"); /* full cleanup */ fclose(g_log_file); return -1; }
-    timer = al_create_timer(1.0 / FPS);
-    if (!timer) { app_log(true, "ERROR", "Failed to create timer!"); /* full cleanup */ fclose(g_log_file); return -1; }
-    event_queue = al_create_event_queue();
-    if (!event_queue) { app_log(true, "ERROR", "Failed to create event_queue!"); /* full cleanup */ fclose(g_log_file); return -1; }
-    font = al_load_ttf_font("arial.ttf", 18, 0);
-    if (!font) { app_log(true, "WARN", "Failed to load 'arial.ttf'. Trying built-in font."); font = al_create_builtin_font(); }
-    if (!font) { app_log(true, "ERROR", "Failed to load any font."); }
-    else { app_log(false, "DEBUG", "Font loaded."); }
-    al_register_event_source(event_queue, al_get_display_event_source(display));
-    al_register_event_source(event_queue, al_get_timer_event_source(timer));
-    al_register_event_source(event_queue, al_get_keyboard_event_source());
-    al_register_event_source(event_queue, al_get_mouse_event_source());
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define STL_VIEWER_X86_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#define TARGET_SSE __attribute__((target("sse")))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
 
-    if (!load_stl_ascii(stl_filename)) { app_log(true, "INFO", "Exiting due to STL load failure."); /* full cleanup */ fclose(g_log_file); return -1; }
+// Translation and, in perspective, the divide (see view_project()) on four projected lanes.
+TARGET_SSE static void store_view4(const ViewTransform* v, VertexPositions* dst, int i, __m128 x, __m128 y, __m128 z) {
+    if (v->perspective) {
+        __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), z);
+        x = _mm_mul_ps(x, w); y = _mm_mul_ps(y, w); z = _mm_xor_ps(w, _mm_set1_ps(-0.0f));
+    }
+    _mm_storeu_ps(dst->x + i, x); _mm_storeu_ps(dst->y + i, y); _mm_storeu_ps(dst->z + i, z);
+}
 
-    bool redraw = true; al_start_timer(timer); bool running = true;
-    app_log(false, "DEBUG", "Entering main loop.");
+TARGET_SSE static void transform_positions_sse(const ViewTransform* v, const VertexPositions* src, VertexPositions* dst, int begin, int end) {
+    __m128 m00 = _mm_set1_ps(v->m[0][0]), m01 = _mm_set1_ps(v->m[0][1]), m02 = _mm_set1_ps(v->m[0][2]), t0 = _mm_set1_ps(v->t[0]);
+    __m128 m10 = _mm_set1_ps(v->m[1][0]), m11 = _mm_set1_ps(v->m[1][1]), m12 = _mm_set1_ps(v->m[1][2]), t1 = _mm_set1_ps(v->t[1]);
+    __m128 m20 = _mm_set1_ps(v->m[2][0]), m21 = _mm_set1_ps(v->m[2][1]), m22 = _mm_set1_ps(v->m[2][2]), t2 = _mm_set1_ps(v->t[2]);
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(src->x + i), y = _mm_loadu_ps(src->y + i), z = _mm_loadu_ps(src->z + i);
+        store_view4(v, dst, i,
+            _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_mul_ps(m02, z)), t0),
+            _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m12, z)), t1),
+            _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_mul_ps(m22, z)), t2));
+    }
+    transform_positions_scalar(v, src, dst, i, end);
+}
 
-    while (running) {
-        ALLEGRO_EVENT ev;
-        al_wait_for_event(event_queue, &ev);
+TARGET_AVX2 static void store_view8(const ViewTransform* v, VertexPositions* dst, int i, __m256 x, __m256 y, __m256 z) {
+    if (v->perspective) {
+        __m256 w = _mm256_div_ps(_mm256_set1_ps(1.0f), z);
+        x = _mm256_mul_ps(x, w); y = _mm256_mul_ps(y, w); z = _mm256_xor_ps(w, _mm256_set1_ps(-0.0f));
+    }
+    _mm256_storeu_ps(dst->x + i, x); _mm256_storeu_ps(dst->y + i, y); _mm256_storeu_ps(dst->z + i, z);
+}
 
-        if (ev.type == ALLEGRO_EVENT_TIMER) {
-            redraw = true;
-        }
-        else if (ev.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
-            running = false;
-        }
-        else if (ev.type == ALLEGRO_EVENT_KEY_DOWN) {
-            if (ev.keyboard.keycode == ALLEGRO_KEY_ESCAPE) { running = false; }
-        }
-        else if (ev.type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN) {
-            if (ev.mouse.button == 1) { is_dragging = true; last_mouse_x = ev.mouse.x; last_mouse_y = ev.mouse.y; }
-        }
-        else if (ev.type == ALLEGRO_EVENT_MOUSE_BUTTON_UP) {
-            if (ev.mouse.button == 1) { is_dragging = false; }
-        }
-        else if (ev.type == ALLEGRO_EVENT_MOUSE_AXES || ev.type == ALLEGRO_EVENT_MOUSE_WARPED) {
-            if (is_dragging) {
-                int mouse_dx = ev.mouse.x - last_mouse_x; int mouse_dy = ev.mouse.y - last_mouse_y;
-                float delta_angle_y_view = -mouse_dx * MOUSE_SENSITIVITY; Point3D view_up_axis = { 0, 1, 0 };
-                Quaternion q_rot_around_view_y = quaternion_from_axis_angle(view_up_axis, delta_angle_y_view);
-                float delta_angle_x_view = -mouse_dy * MOUSE_SENSITIVITY; Point3D view_right_axis = { 1, 0, 0 };
-                Quaternion q_rot_around_view_x = quaternion_from_axis_angle(view_right_axis, delta_angle_x_view);
-                Quaternion screen_space_delta_rotation = quaternion_multiply(q_rot_around_view_y, q_rot_around_view_x);
-                g_orientation = quaternion_multiply(screen_space_delta_rotation, g_orientation);
-                g_orientation = quaternion_normalize(g_orientation);
-                last_mouse_x = ev.mouse.x; last_mouse_y = ev.mouse.y; redraw = true;
-            }
-        }
+TARGET_AVX2 static void transform_positions_avx2(const ViewTransform* v, const VertexPositions* src, VertexPositions* dst, int begin, int end) {
+    __m256 m00 = _mm256_set1_ps(v->m[0][0]), m01 = _mm256_set1_ps(v->m[0][1]), m02 = _mm256_set1_ps(v->m[0][2]), t0 = _mm256_set1_ps(v->t[0]);
+    __m256 m10 = _mm256_set1_ps(v->m[1][0]), m11 = _mm256_set1_ps(v->m[1][1]), m12 = _mm256_set1_ps(v->m[1][2]), t1 = _mm256_set1_ps(v->t[1]);
+    __m256 m20 = _mm256_set1_ps(v->m[2][0]), m21 = _mm256_set1_ps(v->m[2][1]), m22 = _mm256_set1_ps(v->m[2][2]), t2 = _mm256_set1_ps(v->t[2]);
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(src->x + i), y = _mm256_loadu_ps(src->y + i), z = _mm256_loadu_ps(src->z + i);
+        store_view8(v, dst, i,
+            _mm256_fmadd_ps(m00, x, _mm256_fmadd_ps(m01, y, _mm256_fmadd_ps(m02, z, t0))),
+            _mm256_fmadd_ps(m10, x, _mm256_fmadd_ps(m11, y, _mm256_fmadd_ps(m12, z, t1))),
+            _mm256_fmadd_ps(m20, x, _mm256_fmadd_ps(m21, y, _mm256_fmadd_ps(m22, z, t2))));
+    }
+    transform_positions_scalar(v, src, dst, i, end);
+}
 
-        if (redraw && al_is_event_queue_empty(event_queue)) {
-            redraw = false;
-            if (num_faces == 0 || num_vertices == 0) {
-                al_clear_to_color(al_map_rgb(30, 30, 30)); if (font)al_draw_text(font, al_map_rgb(255, 0, 0), SCREEN_W / 2.f, SCREEN_H / 2.f, ALLEGRO_ALIGN_CENTER, "Model empty."); al_flip_display(); continue;
-            }
-            al_clear_to_color(al_map_rgb(30, 30, 30));
+// Four int16 lanes sign-extended to int32 (SSE2 has no cvtepi16): duplicate into the high halves, then shift down.
+TARGET_SSE2 static __m128 load_quantized4(const int16_t* p) {
+    __m128i v = _mm_loadl_epi64((const __m128i*)p);
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
 
-            float rotation_matrix[3][3];
-            quaternion_to_rotation_matrix(g_orientation, rotation_matrix);
+TARGET_SSE2 static void transform_quantized_sse2(const ViewTransform* v, const QuantizedPositions* src, VertexPositions* dst, int begin, int end) {
+    __m128 m00 = _mm_set1_ps(v->m[0][0]), m01 = _mm_set1_ps(v->m[0][1]), m02 = _mm_set1_ps(v->m[0][2]), t0 = _mm_set1_ps(v->t[0]);
+    __m128 m10 = _mm_set1_ps(v->m[1][0]), m11 = _mm_set1_ps(v->m[1][1]), m12 = _mm_set1_ps(v->m[1][2]), t1 = _mm_set1_ps(v->t[1]);
+    __m128 m20 = _mm_set1_ps(v->m[2][0]), m21 = _mm_set1_ps(v->m[2][1]), m22 = _mm_set1_ps(v->m[2][2]), t2 = _mm_set1_ps(v->t[2]);
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = load_quantized4(src->x + i), y = load_quantized4(src->y + i), z = load_quantized4(src->z + i);
+        store_view4(v, dst, i,
+            _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_mul_ps(m02, z)), t0),
+            _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m12, z)), t1),
+            _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_mul_ps(m22, z)), t2));
+    }
+    transform_quantized_scalar(v, src, dst, i, end);
+}
 
-            for (int i = 0; i < num_vertices; ++i) {
-                transformed_vertices[i] = apply_rotation_matrix_to_vertex(rotation_matrix, original_vertices[i]);
-            }
+TARGET_AVX2 static void transform_quantized_avx2(const ViewTransform* v, const QuantizedPositions* src, VertexPositions* dst, int begin, int end) {
+    __m256 m00 = _mm256_set1_ps(v->m[0][0]), m01 = _mm256_set1_ps(v->m[0][1]), m02 = _mm256_set1_ps(v->m[0][2]), t0 = _mm256_set1_ps(v->t[0]);
+    __m256 m10 = _mm256_set1_ps(v->m[1][0]), m11 = _mm256_set1_ps(v->m[1][1]), m12 = _mm256_set1_ps(v->m[1][2]), t1 = _mm256_set1_ps(v->t[1]);
+    __m256 m20 = _mm256_set1_ps(v->m[2][0]), m21 = _mm256_set1_ps(v->m[2][1]), m22 = _mm256_set1_ps(v->m[2][2]), t2 = _mm256_set1_ps(v->t[2]);
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src->x + i))));
+        __m256 y = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src->y + i))));
+        __m256 z = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src->z + i))));
+        store_view8(v, dst, i,
+            _mm256_fmadd_ps(m00, x, _mm256_fmadd_ps(m01, y, _mm256_fmadd_ps(m02, z, t0))),
+            _mm256_fmadd_ps(m10, x, _mm256_fmadd_ps(m11, y, _mm256_fmadd_ps(m12, z, t1))),
+            _mm256_fmadd_ps(m20, x, _mm256_fmadd_ps(m21, y, _mm256_fmadd_ps(m22, z, t2))));
+    }
+    transform_quantized_scalar(v, src, dst, i, end);
+}
 
-            for (int i = 0; i < num_faces; ++i) {
-                if (faces[i].v_idx[0] >= num_vertices || faces[i].v_idx[1] >= num_vertices || faces[i].v_idx[2] >= num_vertices ||
-                    faces[i].v_idx[0] < 0 || faces[i].v_idx[1] < 0 || faces[i].v_idx[2] < 0) {
-                    faces[i].avg_z = FLT_MAX; continue; // Skip if invalid
-                }
-                Vertex v_t0 = transformed_vertices[faces[i].v_idx[0]];
-                Vertex v_t1 = transformed_vertices[faces[i].v_idx[1]];
-                Vertex v_t2 = transformed_vertices[faces[i].v_idx[2]];
+static bool cpu_supports_sse(void) {
+#ifdef _MSC_VER
+    int info[4]; __cpuid(info, 1);
+    return (info[3] & (1 << 25)) != 0;
+#else
+    __builtin_cpu_init(); return __builtin_cpu_supports("sse");
+#endif
+}
 
-                Point3D p0 = { v_t0.x, v_t0.y, v_t0.z }; Point3D p1 = { v_t1.x, v_t1.y, v_t1.z }; Point3D p2 = { v_t2.x, v_t2.y, v_t2.z };
-                Point3D edge1 = vec_subtract(p1, p0); Point3D edge2 = vec_subtract(p2, p0);
-                faces[i].normal = vec_normalize(vec_cross_product(edge1, edge2));
-                faces[i].avg_z = (v_t0.z + v_t1.z + v_t2.z) / 3.0f;
-            }
+static bool cpu_supports_sse2(void) {
+#ifdef _MSC_VER
+    int info[4]; __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init(); return __builtin_cpu_supports("sse2");
+#endif
+}
+
+// AVX2 and FMA in CPUID, plus OS support for saving YMM state (OSXSAVE + XCR0 bits 1 and 2).
+static bool cpu_supports_avx2_fma(void) {
+#ifdef _MSC_VER
+    int info[4]; __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0, osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+    if (!fma || !osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init(); return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
 
-            if (num_faces > 0) qsort(faces, num_faces, sizeof(Face), compare_faces);
+TransformKernelFn g_transform_kernel = transform_positions_scalar;
+QuantizedTransformKernelFn g_quantized_transform_kernel = transform_quantized_scalar;
+const char* g_transform_kernel_name = "scalar";
 
-            for (int i = 0; i < num_faces; ++i) {
-                if (faces[i].v_idx[0] >= num_vertices || faces[i].v_idx[1] >= num_vertices || faces[i].v_idx[2] >= num_vertices) continue;
+static void select_transform_kernel(bool allow_simd) {
+    const char* name = "scalar";
+    g_transform_kernel = transform_positions_scalar; g_quantized_transform_kernel = transform_quantized_scalar;
+#ifdef STL_VIEWER_X86_SIMD
+    if (allow_simd && cpu_supports_avx2_fma()) { g_transform_kernel = transform_positions_avx2; g_quantized_transform_kernel = transform_quantized_avx2; name = "AVX2"; }
+    else if (allow_simd && cpu_supports_sse()) {
+        g_transform_kernel = transform_positions_sse; name = "SSE";
+        if (cpu_supports_sse2()) g_quantized_transform_kernel = transform_quantized_sse2;
+    }
+#else
+    (void)allow_simd;
+#endif
+    g_transform_kernel_name = name;
+    app_log(false, "DEBUG", "Vertex transform kernel: %s", name);
+}
 
-                Vertex v_draw[3]; // Get the vertices for this sorted face
-                v_draw[0] = transformed_vertices[faces[i].v_idx[0]];
-                v_draw[1] = transformed_vertices[faces[i].v_idx[1]];
-                v_draw[2] = transformed_vertices[faces[i].v_idx[2]];
+#define TRANSFORM_BLOCK_VERTICES 65536 // Per-job slice; large enough to amortize dispatch
 
-                // Use the pre-calculated normal for this face for lighting
-                float light_val_draw = ambient_light_intensity + diffuse_light_intensity * fmaxf(0.0f, vec_dot_product(faces[i].normal, light_direction));
-                light_val_draw = fminf(1.0f, fmaxf(0.0f, light_val_draw));
+typedef struct {
+    const ViewTransform* view;
+    const VertexPositions* src;
+    const QuantizedPositions* quantized_src; // Used instead of src when set
+    VertexPositions* dst;
+    int count;
+    const int* spans; // Optional [begin, end) pairs, one per job, used instead of slicing [0, count)
+} TransformJob;
 
-                ALLEGRO_VERTEX tri_verts_allegro[3]; // Allegro's vertex type
-                for (int k = 0; k < 3; ++k) {
-                    tri_verts_allegro[k].x = v_draw[k].x + SCREEN_W / 2.0f;
-                    tri_verts_allegro[k].y = -v_draw[k].y + SCREEN_H / 2.0f;
-                    tri_verts_allegro[k].z = 0;
+static void transform_positions_job(void* context, int job_index) {
+    TransformJob* job = (TransformJob*)context;
+    int begin = job_index * TRANSFORM_BLOCK_VERTICES;
+    int end = begin + TRANSFORM_BLOCK_VERTICES < job->count ? begin + TRANSFORM_BLOCK_VERTICES : job->count;
+    if (job->spans) { begin = job->spans[job_index * 2]; end = job->spans[job_index * 2 + 1]; }
+    if (job->quantized_src) g_quantized_transform_kernel(job->view, job->quantized_src, job->dst, begin, end);
+    else g_transform_kernel(job->view, job->src, job->dst, begin, end);
+}
 
-                    float r_base, g_base, b_base, a_base;
-                    al_unmap_rgba_f(v_draw[k].color, &r_base, &g_base, &b_base, &a_base);
-                    tri_verts_allegro[k].color = al_map_rgba_f(
-                        r_base * light_val_draw, g_base * light_val_draw, b_base * light_val_draw, a_base
-                    );
-                }
-                al_draw_prim(tri_verts_allegro, NULL, 0, 0, 3, ALLEGRO_PRIM_TRIANGLE_LIST);
-            }
+// Projects all count positions, spread over the worker pool in TRANSFORM_BLOCK_VERTICES slices.
+static void transform_positions(const ViewTransform* v, const VertexPositions* src, VertexPositions* dst, int count) {
+    TransformJob job = { v, src, NULL, dst, count, NULL };
+    parallel_for((count + TRANSFORM_BLOCK_VERTICES - 1) / TRANSFORM_BLOCK_VERTICES, transform_positions_job, &job);
+}
 
-            if (font) {
-                char info_text[128];
-                snprintf(info_text, sizeof(info_text), "Faces: %d. Verts: %d. Gradient. ESC exit.", num_faces, num_vertices);
-                al_draw_text(font, al_map_rgb(255, 255, 255), 10, 10, 0, info_text);
-            }
-            al_flip_display();
-        }
-    }
-    app_log(false, "DEBUG", "Exiting main loop.");
+// Same for --compact positions; the output is in the same units as the float path.
+static ViewTransform quantized_view_transform(const ViewTransform* v) {
+    ViewTransform scaled = *v;
+    for (int r = 0; r < 3; ++r) for (int c = 0; c < 3; ++c) scaled.m[r][c] = v->m[r][c] * POSITION_QUANT_STEP;
+    return scaled;
+}
 
-    // No need to free draw_buffer as it's not used in the final drawing loop
+static void transform_quantized_positions(const ViewTransform* v, const QuantizedPositions* src, VertexPositions* dst, int count) {
+    ViewTransform scaled = quantized_view_transform(v);
+    TransformJob job = { &scaled, NULL, src, dst, count, NULL };
+    parallel_for((count + TRANSFORM_BLOCK_VERTICES - 1) / TRANSFORM_BLOCK_VERTICES, transform_positions_job, &job);
+}
 
-    app_log(false, "DEBUG", "Starting cleanup sequence.");
-    cleanup_model_data();
-    if (font) al_destroy_font(font); if (event_queue) al_destroy_event_queue(event_queue);
-    if (timer) al_destroy_timer(timer); if (display) al_destroy_display(display);
-    al_shutdown_ttf_addon(); al_shutdown_font_addon(); al_shutdown_primitives_addon();
-    al_uninstall_mouse(); al_uninstall_keyboard();
-    app_log(true, "INFO", "Application terminated normally.");
-    if (g_log_file) fclose(g_log_file);
-    return 0;
+
+// --- Vector Math (using Point3D) ---
+static Point3D vec_subtract(Point3D a, Point3D b) { return (Point3D) { a.x - b.x, a.y - b.y, a.z - b.z }; }
+static Point3D vec_cross_product(Point3D a, Point3D b) { return (Point3D) { a.y* b.z - a.z * b.y, a.z* b.x - a.x * b.z, a.x* b.y - a.y * b.x }; }
+static float vec_dot_product(Point3D a, Point3D b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static float vec_magnitude(Point3D v_pt) { // Renamed param
+    return sqrtf(v_pt.x * v_pt.x + v_pt.y * v_pt.y + v_pt.z * v_pt.z);
+}
+static Point3D vec_normalize(Point3D v_pt) { // Renamed param
+    float mag = vec_magnitude(v_pt);
+    if (mag == 0.0f || isnan(mag) || isinf(mag)) return (Point3D) { 0, 0, 0 };
+    return (Point3D) { v_pt.x / mag, v_pt.y / mag, v_pt.z / mag };
+}
+static int clamp_int(int v, int lo, int hi) { return v < lo ? lo : (v > hi ? hi : v); }
+// Plain comparisons: fminf/fmaxf handle NaN operands and often compile to library calls in hot loops
+static float min_float(float a, float b) { return a < b ? a : b; }
+static float max_float(float a, float b) { return a > b ? a : b; }
+
+// --- Color Interpolation ---
+// Vertex colors are packed 8-bit RGBA, red in the low byte (Allegro's ABGR_8888 on little-endian machines): a quarter
+// of an ALLEGRO_COLOR, and the renderers scale the channels by the face light with plain arithmetic.
+#define RGBA8_R(c) ((c) & 0xFFu)
+#define RGBA8_G(c) (((c) >> 8) & 0xFFu)
+#define RGBA8_B(c) (((c) >> 16) & 0xFFu)
+#define RGBA8_A(c) ((c) >> 24)
+
+float lerp(float a, float b, float t) { return a + t * (b - a); }
+static uint32_t pack_rgba8(int r, int g, int b, int a) { return (uint32_t)r | (uint32_t)g << 8 | (uint32_t)b << 16 | (uint32_t)a << 24; }
+static int lerp_channel(uint32_t c1, uint32_t c2, float t) { return (int)(lerp((float)c1, (float)c2, t) + 0.5f); }
+uint32_t color_lerp(uint32_t c1, uint32_t c2, float t) {
+    return pack_rgba8(lerp_channel(RGBA8_R(c1), RGBA8_R(c2), t), lerp_channel(RGBA8_G(c1), RGBA8_G(c2), t),
+        lerp_channel(RGBA8_B(c1), RGBA8_B(c2), t), lerp_channel(RGBA8_A(c1), RGBA8_A(c2), t));
+}
+
+
+// --- Memory-Mapped Files ---
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file_handle;
+    HANDLE mapping_handle;
+#endif
+} MappedFile;
+
+static void unmap_file(MappedFile* mf) {
+#ifdef _WIN32
+    if (mf->data) UnmapViewOfFile(mf->data);
+    if (mf->mapping_handle) CloseHandle(mf->mapping_handle);
+    if (mf->file_handle && mf->file_handle != INVALID_HANDLE_VALUE) CloseHandle(mf->file_handle);
+#else
+    if (mf->data) munmap((void*)mf->data, mf->size);
+#endif
+    memset(mf, 0, sizeof(*mf));
+}
+
+// Maps the whole file read-only. Empty files are reported as failures since they cannot be mapped.
+static bool map_file_readonly(const char* filename, MappedFile* mf) {
+    memset(mf, 0, sizeof(*mf));
+#ifdef _WIN32
+    mf->file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mf->file_handle == INVALID_HANDLE_VALUE) { mf->file_handle = NULL; return false; }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(mf->file_handle, &file_size) || file_size.QuadPart == 0) { unmap_file(mf); return false; }
+    mf->size = (size_t)file_size.QuadPart;
+    mf->mapping_handle = CreateFileMappingA(mf->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mf->mapping_handle) { unmap_file(mf); return false; }
+    mf->data = (const unsigned char*)MapViewOfFile(mf->mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (!mf->data) { unmap_file(mf); return false; }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return false; }
+    void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (view == MAP_FAILED) return false;
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+    mf->data = (const unsigned char*)view; mf->size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+static uint32_t read_u32_le(const unsigned char* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static float read_f32_le(const unsigned char* p) { uint32_t bits = read_u32_le(p); float f; memcpy(&f, &bits, sizeof(f)); return f; }
+
+#define STL_TEXT_PROBE_BYTES 4096
+
+// True if the data starts with "solid" (after an optional UTF-8 byte order mark) and a "facet" keyword shows up in the
+// first STL_TEXT_PROBE_BYTES (some exporters write "solid" into binary headers).
+static bool stl_text_looks_ascii(const unsigned char* data, size_t size) {
+    size_t pos = size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF ? 3 : 0;
+    while (pos < size && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n')) pos++;
+    if (size - pos < 5 || memcmp(data + pos, "solid", 5) != 0) return false;
+    size_t probe_end = size < STL_TEXT_PROBE_BYTES ? size : STL_TEXT_PROBE_BYTES;
+    for (size_t i = pos; i + 5 <= probe_end; ++i) { if (memcmp(data + i, "facet", 5) == 0) return true; }
+    return false;
+}
+
+// True if the first STL_TEXT_PROBE_BYTES hold a NUL or another control byte no text file has. The facet count and
+// float records of a binary STL practically always do.
+static bool stl_probe_has_control_bytes(const unsigned char* data, size_t size) {
+    size_t probe_end = size < STL_TEXT_PROBE_BYTES ? size : STL_TEXT_PROBE_BYTES;
+    for (size_t i = 0; i < probe_end; ++i) {
+        unsigned char c = data[i];
+        if ((c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != '\v') || c == 0x7F) return true;
+    }
+    return false;
+}
+
+// Binary vs ASCII from the start of a stream whose total size is unknown (compressed input): binary only if it does
+// not look like an ASCII STL and is clearly not text.
+static bool stl_probe_is_binary(const unsigned char* data, size_t size) {
+    return size >= STL_BINARY_HEADER_SIZE && !stl_text_looks_ascii(data, size) && stl_probe_has_control_bytes(data, size);
+}
+
+// Binary STL if the facet count in the header matches the file size exactly, or if the data is clearly not text (a
+// truncated or padded binary file). Anything else goes to the ASCII parser, which reports what it cannot read.
+static bool stl_data_is_binary(const unsigned char* data, size_t size) {
+    if (size >= STL_BINARY_HEADER_SIZE) {
+        uint64_t expected_size = STL_BINARY_HEADER_SIZE + (uint64_t)read_u32_le(data + 80) * STL_BINARY_FACET_SIZE;
+        if (expected_size == (uint64_t)size) return true;
+    }
+    return stl_probe_is_binary(data, size);
+}
+
+bool g_use_mesh_cache = false; // --cache
+MappedFile g_mesh_cache_view; // Backs the model arrays while a cached model is loaded
+
+// View of the loaded model's global arrays; the returned struct does not own them.
+static RenderMesh full_render_mesh(void) {
+    RenderMesh mesh = { original_positions, transformed_positions, vertex_colors, faces, num_vertices, num_faces, quantized_positions, meshlets, num_meshlets, NULL, 0, meshlet_nodes, num_meshlet_nodes };
+    return mesh;
+}
+
+// Object-space position of vertex i, whichever way the mesh stores it.
+static Point3D render_mesh_vertex(const RenderMesh* mesh, int i) {
+    if (mesh->quantized.x) return (Point3D){ dequantize_position(mesh->quantized.x[i]), dequantize_position(mesh->quantized.y[i]), dequantize_position(mesh->quantized.z[i]) };
+    return (Point3D){ mesh->original.x[i], mesh->original.y[i], mesh->original.z[i] };
+}
+
+static Point3D model_vertex(int i) {
+    if (quantized_positions.x) return (Point3D){ dequantize_position(quantized_positions.x[i]), dequantize_position(quantized_positions.y[i]), dequantize_position(quantized_positions.z[i]) };
+    return (Point3D){ original_positions.x[i], original_positions.y[i], original_positions.z[i] };
+}
+
+static void free_mesh_validation_data(void) {
+    free(g_face_issues); free(g_issue_faces); free(g_issue_edges);
+    g_face_issues = NULL; g_issue_faces = g_issue_edges = NULL; g_num_issue_faces = g_num_issue_edges = 0;
+    g_mesh_validated = false;
+}
+
+static void free_slice_data(void) {
+    free(g_slice_nodes); free(g_slice_by_min); free(g_slice_by_max); free(g_slice_points); free(g_slice_polylines);
+    g_slice_nodes = NULL; g_slice_by_min = g_slice_by_max = NULL; g_slice_root = -1;
+    g_slice_points = NULL; g_slice_polylines = NULL; g_num_slice_polylines = g_num_slice_closed = 0;
+    g_show_slice = false;
+}
+
+// Frees the arrays the loader fills. The loading thread calls this when it fails or is cancelled, so it must not touch
+// anything the render loop uses to draw the preview meanwhile (see free_render_buffers()).
+static void free_loaded_model(void) {
+    if (g_mesh_cache_view.data) { // Loaded from the mesh cache: these arrays live in the mapping, not on the heap
+        original_positions.x = original_positions.y = original_positions.z = NULL;
+        quantized_positions.x = quantized_positions.y = quantized_positions.z = NULL;
+        vertex_colors = NULL; faces = NULL; bvh_nodes = NULL; bvh_face_index = NULL; meshlets = NULL;
+        unmap_file(&g_mesh_cache_view);
+    }
+    free_vertex_positions(&original_positions);
+    free_quantized_positions(&quantized_positions);
+    free_vertex_positions(&transformed_positions);
+    if (vertex_colors) free(vertex_colors);
+    if (faces) free(faces);
+    if (bvh_nodes) free(bvh_nodes);
+    if (bvh_face_index) free(bvh_face_index);
+    if (meshlets) free(meshlets);
+    if (meshlet_nodes) free(meshlet_nodes);
+    meshlet_nodes = NULL; num_meshlet_nodes = 0;
+    vertex_colors = NULL; faces = NULL; meshlets = NULL; num_meshlets = 0;
+    bvh_nodes = NULL; bvh_face_index = NULL; bvh_node_count = 0;
+    num_vertices = 0; num_faces = 0;
+}
+
+// Frees the per-frame draw buffers and everything derived from the model on the main thread. Main thread only, and
+// never while a load is running: the preview is drawn with the same buffers.
+static void free_render_buffers(void) {
+    if (depth_keys) free(depth_keys);
+    if (depth_keys_scratch) free(depth_keys_scratch);
+    if (draw_vertices) free(draw_vertices);
+    if (draw_vertex_buffer) al_destroy_vertex_buffer(draw_vertex_buffer);
+    if (g_visible_meshlets) free(g_visible_meshlets);
+    free_mesh_validation_data();
+    free_slice_data();
+    g_visible_meshlets = g_transform_spans = NULL; g_meshlet_frame_capacity = 0;
+    depth_keys = NULL; depth_keys_scratch = NULL; depth_key_capacity = 0;
+    draw_vertices = NULL; draw_vertex_capacity = 0;
+    draw_vertex_buffer = NULL; draw_vertex_buffer_capacity = 0;
+    g_picked_face = -1;
+}
+
+static void cleanup_model_data() {
+    app_log(false, "DEBUG", "Cleaning up model data.");
+    free_loaded_model();
+    free_render_buffers();
+}
+
+// --- Vertex Welding ---
+#define WELD_GRID_STEPS (1 << 20) // Quantization steps across MODEL_VIEW_SIZE (~0.00014 view units)
+
+static uint32_t weld_hash(int32_t qx, int32_t qy, int32_t qz) {
+    uint32_t h = (uint32_t)qx * 73856093u ^ (uint32_t)qy * 19349663u ^ (uint32_t)qz * 83492791u;
+    h ^= h >> 16; h *= 0x7feb352du; h ^= h >> 15;
+    return h;
+}
+
+// Collapses corners whose normalized positions fall into the same quantization cell into one shared vertex
+// and re-points Face::v_idx at the deduplicated array. Runs on normalized coordinates so the tolerance is
+// relative to the model size.
+static void weld_model_vertices(void) {
+    if (num_vertices == 0) return;
+    int original_count = num_vertices;
+    size_t table_size = 1; while (table_size < (size_t)num_vertices * 2) table_size <<= 1;
+    int* table = (int*)malloc(table_size * sizeof(int));
+    int32_t* keys = (int32_t*)malloc((size_t)num_vertices * 3 * sizeof(int32_t)); // Quantized position per unique vertex
+    int* remap = (int*)malloc((size_t)num_vertices * sizeof(int));
+    if (!table || !keys || !remap) {
+        app_log(true, "WARN", "Not enough memory to weld %d vertices. Keeping the unwelded mesh.", num_vertices);
+        free(table); free(keys); free(remap); return;
+    }
+    memset(table, 0xFF, table_size * sizeof(int)); // -1 marks an empty slot
+
+    const float inv_step = (float)WELD_GRID_STEPS / MODEL_VIEW_SIZE;
+    int unique_count = 0;
+    for (int i = 0; i < num_vertices; ++i) {
+        int32_t qx = (int32_t)floorf(original_positions.x[i] * inv_step + 0.5f);
+        int32_t qy = (int32_t)floorf(original_positions.y[i] * inv_step + 0.5f);
+        int32_t qz = (int32_t)floorf(original_positions.z[i] * inv_step + 0.5f);
+        size_t slot = weld_hash(qx, qy, qz) & (table_size - 1);
+        while (table[slot] >= 0) {
+            const int32_t* k = &keys[table[slot] * 3];
+            if (k[0] == qx && k[1] == qy && k[2] == qz) break;
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] < 0) {
+            table[slot] = unique_count;
+            keys[unique_count * 3 + 0] = qx; keys[unique_count * 3 + 1] = qy; keys[unique_count * 3 + 2] = qz;
+            // unique_count <= i, so this compacts in place
+            original_positions.x[unique_count] = original_positions.x[i];
+            original_positions.y[unique_count] = original_positions.y[i];
+            original_positions.z[unique_count] = original_positions.z[i];
+            unique_count++;
+        }
+        remap[i] = table[slot];
+    }
+    for (int f = 0; f < num_faces; ++f) {
+        for (int k = 0; k < 3; ++k) {
+            int idx = faces[f].v_idx[k];
+            if (idx >= 0 && idx < original_count) faces[f].v_idx[k] = remap[idx];
+        }
+    }
+    free(table); free(keys); free(remap);
+
+    num_vertices = unique_count;
+    VertexPositions shrunk;
+    if (alloc_vertex_positions(&shrunk, num_vertices)) { // Give the freed space back; keep the larger arrays otherwise
+        memcpy(shrunk.x, original_positions.x, (size_t)num_vertices * sizeof(float));
+        memcpy(shrunk.y, original_positions.y, (size_t)num_vertices * sizeof(float));
+        memcpy(shrunk.z, original_positions.z, (size_t)num_vertices * sizeof(float));
+        free_vertex_positions(&original_positions); original_positions = shrunk;
+    }
+    if (alloc_vertex_positions(&shrunk, num_vertices)) { free_vertex_positions(&transformed_positions); transformed_positions = shrunk; }
+    app_log(true, "INFO", "Welded %d vertices into %d unique vertices (%.1fx fewer).", original_count, num_vertices, (double)original_count / (double)num_vertices);
+}
+
+// Stores the object-space unit normal of every face. The scale in finalize_model_data() is uniform, so these stay valid
+// for the normalized positions; each frame only rotates them (see FaceShading). Faces with bad indices get a zero normal.
+static void compute_face_normals(const VertexPositions* positions, Face* mesh_faces, int face_count, int vertex_count) {
+    const float* px = positions->x; const float* py = positions->y; const float* pz = positions->z;
+    for (int i = 0; i < face_count; ++i) {
+        int i0 = mesh_faces[i].v_idx[0], i1 = mesh_faces[i].v_idx[1], i2 = mesh_faces[i].v_idx[2];
+        if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= vertex_count || i1 >= vertex_count || i2 >= vertex_count) { mesh_faces[i].normal = (Point3D){ 0, 0, 0 }; continue; }
+        Point3D p0 = { px[i0], py[i0], pz[i0] }; Point3D p1 = { px[i1], py[i1], pz[i1] }; Point3D p2 = { px[i2], py[i2], pz[i2] };
+        mesh_faces[i].normal = vec_normalize(vec_cross_product(vec_subtract(p1, p0), vec_subtract(p2, p0)));
+    }
+}
+
+// --- Bounding Volume Hierarchy (picking) ---
+// Built once per load over the normalized positions with binned SAH splits. Picking casts the screen ray through
+// the inverse rotation into object space and walks the tree nearest child first, so a query touches a few dozen
+// nodes instead of every face.
+#define BVH_LEAF_FACES 4      // Always stop splitting at this size
+#define BVH_MAX_LEAF_FACES 16 // Ranges up to this size may stay leaves when SAH finds no better split
+#define BVH_COMPACT_LEAF_FACES 32 // --compact: bigger leaves, about an eighth of the nodes for slightly slower picks
+#define BVH_COMPACT_MAX_LEAF_FACES 64
+#define BVH_SAH_BINS 16
+#define BVH_MAX_DEPTH 60       // Deeper ranges stay leaves, which bounds the traversal stack
+
+static void bvh_face_bounds(int f, float bmin[3], float bmax[3]) {
+    for (int a = 0; a < 3; ++a) { bmin[a] = FLT_MAX; bmax[a] = -FLT_MAX; }
+    for (int k = 0; k < 3; ++k) {
+        int vi = faces[f].v_idx[k];
+        if (vi < 0 || vi >= num_vertices) continue;
+        float p[3] = { original_positions.x[vi], original_positions.y[vi], original_positions.z[vi] };
+        for (int a = 0; a < 3; ++a) { bmin[a] = min_float(bmin[a], p[a]); bmax[a] = max_float(bmax[a], p[a]); }
+    }
+}
+
+static float bvh_half_area(const float bmin[3], const float bmax[3]) {
+    float dx = bmax[0] - bmin[0], dy = bmax[1] - bmin[1], dz = bmax[2] - bmin[2];
+    return (dx < 0.0f || dy < 0.0f || dz < 0.0f) ? 0.0f : dx * dy + dy * dz + dz * dx;
+}
+
+static void free_bvh(void) {
+    free(bvh_nodes); free(bvh_face_index);
+    bvh_nodes = NULL; bvh_face_index = NULL; bvh_node_count = 0;
+}
+
+static bool build_bvh(void) {
+    free_bvh();
+    if (num_faces == 0) return true;
+    double start_time = al_get_time();
+    const int leaf_faces = g_compact_positions ? BVH_COMPACT_LEAF_FACES : BVH_LEAF_FACES;
+    const int max_leaf_faces = g_compact_positions ? BVH_COMPACT_MAX_LEAF_FACES : BVH_MAX_LEAF_FACES;
+    bvh_nodes = (BvhNode*)malloc((size_t)num_faces * 2 * sizeof(BvhNode));
+    bvh_face_index = (int*)malloc((size_t)num_faces * sizeof(int));
+    float* boxes = (float*)malloc((size_t)num_faces * 6 * sizeof(float)); // min xyz, max xyz; permuted with bvh_face_index
+    if (!bvh_nodes || !bvh_face_index || !boxes) {
+        app_log(true, "WARN", "Not enough memory for the picking BVH over %d faces; picking is disabled.", num_faces);
+        free(boxes); free_bvh(); return false;
+    }
+    for (int f = 0; f < num_faces; ++f) {
+        bvh_face_bounds(f, &boxes[f * 6], &boxes[f * 6 + 3]);
+        if (boxes[f * 6] > boxes[f * 6 + 3]) memset(&boxes[f * 6], 0, 6 * sizeof(float)); // No valid corner
+        bvh_face_index[f] = f;
+    }
+
+    int stack[BVH_MAX_DEPTH + 2][2]; int stack_size = 0; // (node, depth)
+    bvh_node_count = 1; bvh_nodes[0].first = 0; bvh_nodes[0].count = num_faces;
+    stack[stack_size][0] = 0; stack[stack_size++][1] = 0;
+    while (stack_size > 0) {
+        --stack_size;
+        BvhNode* node = &bvh_nodes[stack[stack_size][0]]; int depth = stack[stack_size][1];
+        int first = node->first, count = node->count;
+        float cmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (int a = 0; a < 3; ++a) { node->min[a] = FLT_MAX; node->max[a] = -FLT_MAX; }
+        for (int i = first; i < first + count; ++i) {
+            const float* box = &boxes[i * 6];
+            for (int a = 0; a < 3; ++a) {
+                float c = 0.5f * (box[a] + box[a + 3]);
+                node->min[a] = min_float(node->min[a], box[a]); node->max[a] = max_float(node->max[a], box[a + 3]);
+                cmin[a] = min_float(cmin[a], c); cmax[a] = max_float(cmax[a], c);
+            }
+        }
+        if (count <= leaf_faces || depth >= BVH_MAX_DEPTH) continue;
+        int axis = 0;
+        for (int a = 1; a < 3; ++a) if (cmax[a] - cmin[a] > cmax[axis] - cmin[axis]) axis = a;
+        float extent = cmax[axis] - cmin[axis];
+        if (!(extent > 1e-12f) && count <= max_leaf_faces) continue;
+
+        // Bin centroids along the axis and pick the cheapest split plane by surface area heuristic
+        int split = first + count / 2; // Fallback when every centroid coincides or SAH finds nothing
+        if (extent > 1e-12f) {
+            int bin_count[BVH_SAH_BINS] = { 0 }; float bin_min[BVH_SAH_BINS][3], bin_max[BVH_SAH_BINS][3];
+            for (int b = 0; b < BVH_SAH_BINS; ++b) for (int a = 0; a < 3; ++a) { bin_min[b][a] = FLT_MAX; bin_max[b][a] = -FLT_MAX; }
+            float bin_scale = BVH_SAH_BINS / extent;
+            for (int i = first; i < first + count; ++i) {
+                const float* box = &boxes[i * 6];
+                int b = clamp_int((int)((0.5f * (box[axis] + box[axis + 3]) - cmin[axis]) * bin_scale), 0, BVH_SAH_BINS - 1);
+                bin_count[b]++;
+                for (int a = 0; a < 3; ++a) { bin_min[b][a] = min_float(bin_min[b][a], box[a]); bin_max[b][a] = max_float(bin_max[b][a], box[a + 3]); }
+            }
+            float right_area[BVH_SAH_BINS]; int right_count[BVH_SAH_BINS];
+            float acc_min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, acc_max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX }; int acc = 0;
+            for (int b = BVH_SAH_BINS - 1; b > 0; --b) {
+                acc += bin_count[b];
+                for (int a = 0; a < 3; ++a) { acc_min[a] = min_float(acc_min[a], bin_min[b][a]); acc_max[a] = max_float(acc_max[a], bin_max[b][a]); }
+                right_count[b] = acc; right_area[b] = bvh_half_area(acc_min, acc_max);
+            }
+            float best_cost = FLT_MAX; int best_bin = -1; acc = 0;
+            for (int a = 0; a < 3; ++a) { acc_min[a] = FLT_MAX; acc_max[a] = -FLT_MAX; }
+            for (int b = 0; b < BVH_SAH_BINS - 1; ++b) {
+                acc += bin_count[b];
+                for (int a = 0; a < 3; ++a) { acc_min[a] = min_float(acc_min[a], bin_min[b][a]); acc_max[a] = max_float(acc_max[a], bin_max[b][a]); }
+                if (acc == 0 || right_count[b + 1] == 0) continue;
+                float cost = acc * bvh_half_area(acc_min, acc_max) + right_count[b + 1] * right_area[b + 1];
+                if (cost < best_cost) { best_cost = cost; best_bin = b; }
+            }
+            if (best_bin >= 0 && count <= max_leaf_faces && best_cost >= count * bvh_half_area(node->min, node->max)) continue;
+            if (best_bin >= 0) { // Partition in place: faces in bins <= best_bin go left
+                int lo = first, hi = first + count - 1;
+                while (lo <= hi) {
+                    float* box = &boxes[lo * 6];
+                    if (clamp_int((int)((0.5f * (box[axis] + box[axis + 3]) - cmin[axis]) * bin_scale), 0, BVH_SAH_BINS - 1) <= best_bin) { lo++; continue; }
+                    float tmp_box[6]; memcpy(tmp_box, box, sizeof(tmp_box)); memcpy(box, &boxes[hi * 6], sizeof(tmp_box)); memcpy(&boxes[hi * 6], tmp_box, sizeof(tmp_box));
+                    int tmp_face = bvh_face_index[lo]; bvh_face_index[lo] = bvh_face_index[hi]; bvh_face_index[hi] = tmp_face;
+                    hi--;
+                }
+                if (lo > first && lo < first + count) split = lo;
+            }
+        }
+        int left = bvh_node_count; bvh_node_count += 2;
+        bvh_nodes[left].first = first; bvh_nodes[left].count = split - first;
+        bvh_nodes[left + 1].first = split; bvh_nodes[left + 1].count = first + count - split;
+        node->first = left; node->count = 0; // Interior: children at left and left + 1
+        stack[stack_size][0] = left + 1; stack[stack_size++][1] = depth + 1;
+        stack[stack_size][0] = left; stack[stack_size++][1] = depth + 1;
+    }
+    free(boxes);
+    app_log(false, "DEBUG", "Picking BVH: %d nodes over %d faces in %.3f s.", bvh_node_count, num_faces, al_get_time() - start_time);
+    return true;
+}
+
+// Slab test; returns the entry distance or FLT_MAX when the ray misses the box before t_max.
+static float bvh_ray_box(const BvhNode* node, const float origin[3], const float inv_dir[3], float t_max) {
+    float t0 = 0.0f, t1 = t_max;
+    for (int a = 0; a < 3; ++a) {
+        float near_t = (node->min[a] - origin[a]) * inv_dir[a], far_t = (node->max[a] - origin[a]) * inv_dir[a];
+        if (near_t > far_t) { float t = near_t; near_t = far_t; far_t = t; }
+        t0 = near_t > t0 ? near_t : t0; t1 = far_t < t1 ? far_t : t1;
+        if (t0 > t1) return FLT_MAX;
+    }
+    return t0;
+}
+
+// Moller-Trumbore, two-sided. Returns the hit distance or FLT_MAX.
+static float ray_triangle(const float origin[3], const float dir[3], int f) {
+    const int* v = faces[f].v_idx;
+    if (v[0] < 0 || v[1] < 0 || v[2] < 0 || v[0] >= num_vertices || v[1] >= num_vertices || v[2] >= num_vertices) return FLT_MAX;
+    Point3D p0 = model_vertex(v[0]), p1 = model_vertex(v[1]), p2 = model_vertex(v[2]);
+    Point3D o = { origin[0], origin[1], origin[2] }, d = { dir[0], dir[1], dir[2] };
+    Point3D e1 = vec_subtract(p1, p0), e2 = vec_subtract(p2, p0);
+    Point3D pv = vec_cross_product(d, e2);
+    float det = vec_dot_product(e1, pv);
+    if (fabsf(det) < 1e-12f) return FLT_MAX;
+    float inv_det = 1.0f / det;
+    Point3D tv = vec_subtract(o, p0);
+    float u = vec_dot_product(tv, pv) * inv_det;
+    if (u < 0.0f || u > 1.0f) return FLT_MAX;
+    Point3D qv = vec_cross_product(tv, e1);
+    float w = vec_dot_product(d, qv) * inv_det;
+    if (w < 0.0f || u + w > 1.0f) return FLT_MAX;
+    float t = vec_dot_product(e2, qv) * inv_det;
+    return t >= 0.0f ? t : FLT_MAX;
+}
+
+// Nearest face hit by the object-space ray, or -1. *hit_t receives the distance along dir.
+static int bvh_pick(const float origin[3], const float dir[3], float* hit_t) {
+    if (!bvh_nodes) return -1;
+    float inv_dir[3];
+    for (int a = 0; a < 3; ++a) inv_dir[a] = dir[a] != 0.0f ? 1.0f / dir[a] : FLT_MAX;
+    int stack[BVH_MAX_DEPTH + 2]; int stack_size = 0; int best_face = -1; float best_t = FLT_MAX; // Depth-first: at most depth + 1 pending
+    if (bvh_ray_box(&bvh_nodes[0], origin, inv_dir, best_t) != FLT_MAX) stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const BvhNode* node = &bvh_nodes[stack[--stack_size]];
+        if (node->count > 0) {
+            for (int i = node->first; i < node->first + node->count; ++i) {
+                float t = ray_triangle(origin, dir, bvh_face_index[i]);
+                if (t < best_t) { best_t = t; best_face = bvh_face_index[i]; }
+            }
+            continue;
+        }
+        int near_child = node->first, far_child = node->first + 1;
+        float t_near = bvh_ray_box(&bvh_nodes[near_child], origin, inv_dir, best_t);
+        float t_far = bvh_ray_box(&bvh_nodes[far_child], origin, inv_dir, best_t);
+        if (t_far < t_near) { float t = t_near; t_near = t_far; t_far = t; int c = near_child; near_child = far_child; far_child = c; }
+        if (t_far != FLT_MAX) stack[stack_size++] = far_child;
+        if (t_near != FLT_MAX) stack[stack_size++] = near_child; // Popped first
+    }
+    *hit_t = best_t;
+    return best_face;
+}
+
+// Casts the pick ray through window pixel (mouse_x, mouse_y) with the current orientation and camera.
+static int pick_face_at(int mouse_x, int mouse_y, Point3D* hit_point) {
+    ViewTransform view = camera_view(g_orientation);
+    float origin[3], dir[3];
+    view_ray(&view, mouse_x, mouse_y, origin, dir);
+    float t = FLT_MAX;
+    int face = bvh_pick(origin, dir, &t);
+    if (face >= 0) *hit_point = (Point3D){ origin[0] + t * dir[0], origin[1] + t * dir[1], origin[2] + t * dir[2] };
+    return face;
+}
+
+// Converts a normalized object-space point back to the units of the STL file.
+static Point3D to_model_units(Point3D p) {
+    return (Point3D){ p.x / g_model_scale + g_model_center.x, p.y / g_model_scale + g_model_center.y, p.z / g_model_scale + g_model_center.z };
+}
+
+static void pick_and_report(int mouse_x, int mouse_y) {
+    double start_time = al_get_time();
+    Point3D hit = { 0, 0, 0 };
+    g_picked_face = pick_face_at(mouse_x, mouse_y, &hit);
+    double elapsed_us = (al_get_time() - start_time) * 1e6;
+    if (g_picked_face < 0) { app_log(false, "DEBUG", "Pick at (%d, %d): no face (%.1f us).", mouse_x, mouse_y, elapsed_us); return; }
+    const int* v = faces[g_picked_face].v_idx;
+    Point3D p[3];
+    for (int k = 0; k < 3; ++k) p[k] = to_model_units(model_vertex(v[k]));
+    Point3D n = vec_cross_product(vec_subtract(p[1], p[0]), vec_subtract(p[2], p[0]));
+    g_picked_point = to_model_units(hit);
+    g_picked_area = 0.5f * sqrtf(vec_dot_product(n, n));
+    app_log(true, "INFO", "Picked face %d at (%g, %g, %g): v0 (%g, %g, %g) v1 (%g, %g, %g) v2 (%g, %g, %g), area %g (%.1f us).", g_picked_face,
+        g_picked_point.x, g_picked_point.y, g_picked_point.z, p[0].x, p[0].y, p[0].z, p[1].x, p[1].y, p[1].z, p[2].x, p[2].y, p[2].z, g_picked_area, elapsed_us);
+    uint8_t issues = g_face_issues ? g_face_issues[g_picked_face] : 0;
+    if (issues) app_log(true, "INFO", "Face %d issues:%s%s%s%s%s", g_picked_face, (issues & VALIDATE_OPEN_EDGE) ? " open edge" : "",
+        (issues & VALIDATE_NON_MANIFOLD) ? " non-manifold edge" : "", (issues & VALIDATE_WINDING) ? " inconsistent winding" : "",
+        (issues & VALIDATE_DUPLICATE) ? " duplicate" : "", (issues & VALIDATE_DEGENERATE) ? " degenerate" : "");
+}
+
+// Outlines and tints the picked face of the full mesh, seen through view, on top of whatever was rendered.
+static void draw_picked_face(const ViewTransform* view) {
+    if (g_picked_face < 0 || g_picked_face >= num_faces) return;
+    float sx[3], sy[3];
+    for (int k = 0; k < 3; ++k) {
+        Point3D p = view_project(view, model_vertex(faces[g_picked_face].v_idx[k]));
+        sx[k] = p.x + SCREEN_W / 2.0f;
+        sy[k] = -p.y + SCREEN_H / 2.0f;
+    }
+    al_draw_filled_triangle(sx[0], sy[0], sx[1], sy[1], sx[2], sy[2], al_map_rgba_f(0.5f, 0.5f, 0.0f, 0.5f)); // Premultiplied
+    al_draw_triangle(sx[0], sy[0], sx[1], sy[1], sx[2], sy[2], al_map_rgb(255, 255, 0), 1.5f);
+}
+
+// --- Meshlets ---
+// At load, build_meshlets() splits the faces into meshlets: compact clusters made by halving the face set at the median
+// centroid along its longest axis until at most MESHLET_MAX_FACES remain. faces[] is reordered so every meshlet is a
+// contiguous range, and vertices are renumbered by first use in that order so a meshlet's corners share a narrow index
+// range. Each meshlet keeps a bounding sphere and a cone around its face normals, and a sphere tree over the meshlets
+// lets culling drop off-screen regions wholesale. Every frame, transform_render_mesh() rejects meshlets that are off
+// screen or (with back-face culling on) facing away as a whole, projects only the vertices of the rest, and the
+// renderers walk only their faces. The per-face tests still run on what survives, so the picture is unchanged.
+#define MESHLET_MAX_FACES 128    // Halving stops at or below this, so a larger mesh gets meshlets of 64-128 faces
+#define MESHLET_NO_CONE 2.0f     // cone_cutoff when the normals span a hemisphere or more; never rejected
+#define MESHLET_CONE_SLACK 1e-3f // Keeps meshlets with nearly edge-on faces away from the rounding edge
+#define MESHLET_SPLIT_STACK 64
+
+static void free_meshlets(void) {
+    free(meshlets);
+    meshlets = NULL; num_meshlets = 0;
+}
+
+static bool face_corners_valid(const Face* face, int vertex_count) {
+    const int* v = face->v_idx;
+    return v[0] >= 0 && v[1] >= 0 && v[2] >= 0 && v[0] < vertex_count && v[1] < vertex_count && v[2] < vertex_count;
+}
+
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Quickselect: afterwards order[nth] holds the face whose centroid would be there if [begin, end) were sorted along
+// axis, with smaller ones before it and larger ones after.
+static void meshlet_select(int* order, const float* centroids, int axis, int begin, int end, int nth) {
+    while (end - begin > 1) {
+        float pivot = centroids[order[begin + (end - begin) / 2] * 3 + axis];
+        int i = begin, j = end - 1;
+        while (i <= j) {
+            while (centroids[order[i] * 3 + axis] < pivot) i++;
+            while (centroids[order[j] * 3 + axis] > pivot) j--;
+            if (i <= j) { int t = order[i]; order[i] = order[j]; order[j] = t; i++; j--; }
+        }
+        if (nth <= j) end = j + 1;
+        else if (nth >= i) begin = i;
+        else return;
+    }
+}
+
+// Bounding sphere, normal cone and vertex range of one meshlet, from the already reordered faces.
+static void compute_meshlet_bounds(Meshlet* ml) {
+    const float* px = original_positions.x; const float* py = original_positions.y; const float* pz = original_positions.z;
+    float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    int vertex_min = INT_MAX, vertex_max = -1;
+    Point3D axis = { 0, 0, 0 };
+    for (int f = ml->first_face; f < ml->first_face + ml->face_count; ++f) {
+        if (!face_corners_valid(&faces[f], num_vertices)) continue;
+        for (int k = 0; k < 3; ++k) {
+            int vi = faces[f].v_idx[k];
+            if (vi < vertex_min) vertex_min = vi;
+            if (vi > vertex_max) vertex_max = vi;
+            lo[0] = fminf(lo[0], px[vi]); lo[1] = fminf(lo[1], py[vi]); lo[2] = fminf(lo[2], pz[vi]);
+            hi[0] = fmaxf(hi[0], px[vi]); hi[1] = fmaxf(hi[1], py[vi]); hi[2] = fmaxf(hi[2], pz[vi]);
+        }
+        axis.x += faces[f].normal.x; axis.y += faces[f].normal.y; axis.z += faces[f].normal.z;
+    }
+    memset(ml->center, 0, sizeof(ml->center)); ml->radius = 0.0f;
+    ml->cone_axis[0] = ml->cone_axis[1] = ml->cone_axis[2] = 0.0f; ml->cone_cutoff = MESHLET_NO_CONE;
+    ml->first_vertex = 0; ml->vertex_count = 0;
+    if (vertex_max < 0) return; // Only faces with bad indices; never drawn
+    ml->first_vertex = vertex_min; ml->vertex_count = vertex_max - vertex_min + 1;
+    for (int a = 0; a < 3; ++a) ml->center[a] = 0.5f * (lo[a] + hi[a]);
+    float radius_sq = 0.0f;
+    for (int f = ml->first_face; f < ml->first_face + ml->face_count; ++f) {
+        if (!face_corners_valid(&faces[f], num_vertices)) continue;
+        for (int k = 0; k < 3; ++k) {
+            int vi = faces[f].v_idx[k];
+            float dx = px[vi] - ml->center[0], dy = py[vi] - ml->center[1], dz = pz[vi] - ml->center[2];
+            radius_sq = fmaxf(radius_sq, dx * dx + dy * dy + dz * dz);
+        }
+    }
+    ml->radius = sqrtf(radius_sq) * 1.0001f + 1e-4f;
+
+    float length = vec_magnitude(axis);
+    if (!(length > 1e-6f)) return;
+    axis = (Point3D){ axis.x / length, axis.y / length, axis.z / length };
+    float min_dot = 1.0f; // Cosine of the widest normal's angle to the axis; zero normals of degenerate faces count as 90 degrees
+    for (int f = ml->first_face; f < ml->first_face + ml->face_count; ++f) {
+        if (face_corners_valid(&faces[f], num_vertices)) min_dot = fminf(min_dot, vec_dot_product(axis, faces[f].normal));
+    }
+    ml->cone_axis[0] = axis.x; ml->cone_axis[1] = axis.y; ml->cone_axis[2] = axis.z;
+    if (min_dot > 0.0f) ml->cone_cutoff = sqrtf(fmaxf(0.0f, 1.0f - min_dot * min_dot)) + MESHLET_CONE_SLACK;
+}
+
+// Reorders faces[] and renumbers the vertices into meshlet order, then fills meshlets[]. Runs after the face normals
+// and before the BVH and colors. On failure the mesh is left untouched and renders without meshlets.
+static bool build_meshlets(void) {
+    free_meshlets();
+    if (num_faces == 0 || num_vertices == 0) return true;
+    double start_time = al_get_time();
+    int capacity = num_faces / (MESHLET_MAX_FACES / 2) + 1; // Halving a range above MESHLET_MAX_FACES leaves at least half of it
+    int* order = (int*)malloc((size_t)num_faces * sizeof(int));
+    float* centroids = (float*)malloc((size_t)num_faces * 3 * sizeof(float)); // Corner sums; the ordering is the same
+    int* remap = (int*)malloc((size_t)num_vertices * sizeof(int));
+    Face* sorted_faces = (Face*)malloc((size_t)num_faces * sizeof(Face));
+    VertexPositions sorted_positions;
+    bool positions_ok = alloc_vertex_positions(&sorted_positions, num_vertices);
+    meshlets = (Meshlet*)malloc((size_t)capacity * sizeof(Meshlet));
+    if (!order || !centroids || !remap || !sorted_faces || !positions_ok || !meshlets) {
+        app_log(true, "WARN", "Not enough memory to build meshlets for %d faces; rendering walks every face.", num_faces);
+        free(order); free(centroids); free(remap); free(sorted_faces);
+        if (positions_ok) free_vertex_positions(&sorted_positions);
+        free_meshlets(); return false;
+    }
+    const float* px = original_positions.x; const float* py = original_positions.y; const float* pz = original_positions.z;
+    for (int f = 0; f < num_faces; ++f) {
+        float* c = &centroids[f * 3];
+        order[f] = f; c[0] = c[1] = c[2] = 0.0f;
+        if (!face_corners_valid(&faces[f], num_vertices)) continue;
+        for (int k = 0; k < 3; ++k) { int vi = faces[f].v_idx[k]; c[0] += px[vi]; c[1] += py[vi]; c[2] += pz[vi]; }
+    }
+
+    int stack[MESHLET_SPLIT_STACK][2]; int stack_size = 0; // [begin, end) ranges of order, left halves popped first
+    stack[stack_size][0] = 0; stack[stack_size++][1] = num_faces;
+    while (stack_size > 0) {
+        --stack_size;
+        int begin = stack[stack_size][0], end = stack[stack_size][1];
+        if (end - begin <= MESHLET_MAX_FACES || stack_size + 2 > MESHLET_SPLIT_STACK) {
+            qsort(order + begin, (size_t)(end - begin), sizeof(int), compare_ints); // File order inside a meshlet keeps strips together
+            meshlets[num_meshlets].first_face = begin; meshlets[num_meshlets].face_count = end - begin; num_meshlets++;
+            continue;
+        }
+        float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (int i = begin; i < end; ++i) {
+            const float* c = &centroids[order[i] * 3];
+            for (int a = 0; a < 3; ++a) { lo[a] = fminf(lo[a], c[a]); hi[a] = fmaxf(hi[a], c[a]); }
+        }
+        int axis = 0;
+        for (int a = 1; a < 3; ++a) if (hi[a] - lo[a] > hi[axis] - lo[axis]) axis = a;
+        int mid = begin + (end - begin) / 2;
+        meshlet_select(order, centroids, axis, begin, end, mid);
+        stack[stack_size][0] = mid; stack[stack_size++][1] = end;
+        stack[stack_size][0] = begin; stack[stack_size++][1] = mid;
+    }
+
+    // Renumber vertices by first use in the new face order; vertices no face uses go last
+    memset(remap, 0xFF, (size_t)num_vertices * sizeof(int));
+    int next_vertex = 0;
+    for (int n = 0; n < num_faces; ++n) {
+        sorted_faces[n] = faces[order[n]];
+        if (!face_corners_valid(&sorted_faces[n], num_vertices)) continue;
+        for (int k = 0; k < 3; ++k) {
+            int* slot = &remap[sorted_faces[n].v_idx[k]];
+            if (*slot < 0) *slot = next_vertex++;
+            sorted_faces[n].v_idx[k] = *slot;
+        }
+    }
+    for (int i = 0; i < num_vertices; ++i) {
+        if (remap[i] < 0) remap[i] = next_vertex++;
+        sorted_positions.x[remap[i]] = px[i]; sorted_positions.y[remap[i]] = py[i]; sorted_positions.z[remap[i]] = pz[i];
+    }
+    memcpy(faces, sorted_faces, (size_t)num_faces * sizeof(Face));
+    free_vertex_positions(&original_positions); original_positions = sorted_positions;
+    free(order); free(centroids); free(remap); free(sorted_faces);
+
+    for (int n = 0; n < num_meshlets; ++n) compute_meshlet_bounds(&meshlets[n]);
+    Meshlet* shrunk = (Meshlet*)realloc(meshlets, (size_t)num_meshlets * sizeof(Meshlet));
+    if (shrunk) meshlets = shrunk;
+    app_log(true, "INFO", "Built %d meshlets (%.1f faces each) in %.3f s.", num_meshlets, (double)num_faces / num_meshlets, al_get_time() - start_time);
+    return true;
+}
+
+static bool reserve_meshlet_frame(int count) {
+    if (count <= g_meshlet_frame_capacity) return true;
+    int* block = (int*)realloc(g_visible_meshlets, (size_t)count * 3 * sizeof(int)); // Visible list, then span pairs
+    if (!block) { app_log(true, "ERROR", "Failed to allocate meshlet culling buffers for %d meshlets.", count); return false; }
+    g_visible_meshlets = block; g_transform_spans = block + count; g_meshlet_frame_capacity = count;
+    return true;
+}
+
+static void free_meshlet_nodes(void) {
+    free(meshlet_nodes);
+    meshlet_nodes = NULL; num_meshlet_nodes = 0;
+}
+
+// Smallest sphere around two spheres, slightly enlarged against rounding. A negative radius is an empty sphere.
+static void merge_spheres(const float a[3], float ra, const float b[3], float rb, float out[3], float* out_radius) {
+    if (rb < 0.0f) { memcpy(out, a, 3 * sizeof(float)); *out_radius = ra; return; }
+    if (ra < 0.0f) { memcpy(out, b, 3 * sizeof(float)); *out_radius = rb; return; }
+    float d[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float dist = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    if (dist + rb <= ra) { memcpy(out, a, 3 * sizeof(float)); *out_radius = ra; return; }
+    if (dist + ra <= rb) { memcpy(out, b, 3 * sizeof(float)); *out_radius = rb; return; }
+    float radius = 0.5f * (dist + ra + rb), t = (radius - ra) / dist;
+    for (int k = 0; k < 3; ++k) out[k] = a[k] + d[k] * t;
+    *out_radius = radius * 1.0001f + 1e-4f;
+}
+
+// Fills the subtree for count meshlets starting at first, rooted at node index, and returns the index after it.
+static int build_meshlet_subtree(int index, int first, int count) {
+    MeshletNode* node = &meshlet_nodes[index];
+    node->first_meshlet = first; node->meshlet_count = count; node->skip = index + 2 * count - 1;
+    if (count == 1) {
+        const Meshlet* ml = &meshlets[first];
+        memcpy(node->center, ml->center, sizeof(node->center));
+        node->radius = ml->vertex_count > 0 ? ml->radius : -1.0f;
+        return node->skip;
+    }
+    int left = index + 1, right = build_meshlet_subtree(left, first, count / 2);
+    build_meshlet_subtree(right, first + count / 2, count - count / 2);
+    merge_spheres(meshlet_nodes[left].center, meshlet_nodes[left].radius, meshlet_nodes[right].center, meshlet_nodes[right].radius, node->center, &node->radius);
+    return node->skip;
+}
+
+// Balanced binary tree of bounding spheres over meshlets[], in preorder so culling walks it front to back without a
+// stack. Meshlets are already spatially ordered by the median splits, so halving their index range keeps nodes tight.
+// Not stored in the mesh cache: it takes a few milliseconds and keeps the cache format unchanged.
+static bool build_meshlet_nodes(void) {
+    free_meshlet_nodes();
+    if (num_meshlets == 0) return true;
+    meshlet_nodes = (MeshletNode*)malloc((size_t)(2 * num_meshlets - 1) * sizeof(MeshletNode));
+    if (!meshlet_nodes) { app_log(true, "WARN", "Not enough memory for the meshlet hierarchy; culling tests every meshlet."); return false; }
+    num_meshlet_nodes = build_meshlet_subtree(0, 0, num_meshlets);
+    return true;
+}
+
+// True when, with back-face culling on, every face in the meshlet's normal cone points away from the viewer. In
+// orthographic views the cone test needs no apex: all normals within the cone face away when the angle between the
+// axis and the view direction is below 90 degrees minus the cone's half angle. In perspective the view direction
+// varies over the sphere, so the test is done against the direction to its center, widened by the radius.
+static bool meshlet_faces_away(const ViewTransform* view, const Meshlet* ml) {
+    if (!g_backface_culling) return false;
+    if (!view->perspective) {
+        const float* view_z = view->rotation[2]; // Object-space direction that becomes +z
+        return ml->cone_axis[0] * view_z[0] + ml->cone_axis[1] * view_z[1] + ml->cone_axis[2] * view_z[2] > ml->cone_cutoff;
+    }
+    float d[3] = { ml->center[0] - view->eye.x, ml->center[1] - view->eye.y, ml->center[2] - view->eye.z };
+    float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    return d[0] * ml->cone_axis[0] + d[1] * ml->cone_axis[1] + d[2] * ml->cone_axis[2] > ml->cone_cutoff * distance + ml->radius;
+}
+
+static void add_visible_meshlets(const ViewTransform* view, RenderMesh* mesh, int first, int count) {
+    for (int n = first; n < first + count; ++n) {
+        const Meshlet* ml = &mesh->meshlets[n];
+        if (ml->vertex_count == 0 || meshlet_faces_away(view, ml)) continue;
+        mesh->visible_meshlets[mesh->num_visible_meshlets++] = n;
+    }
+}
+
+// Keeps the meshlets of mesh that may contribute a pixel in view: some part of the bounding sphere is on screen and
+// not every face faces away. The hierarchy drops whole off-screen subtrees with one test and skips the screen tests
+// below nodes that are entirely on screen, so a zoomed-in view costs about as much as what it shows.
+static void cull_meshlets(const ViewTransform* view, RenderMesh* mesh) {
+    mesh->num_visible_meshlets = 0;
+    if (!mesh->meshlet_nodes) {
+        for (int n = 0; n < mesh->num_meshlets; ++n) {
+            const Meshlet* ml = &mesh->meshlets[n];
+            if (ml->vertex_count > 0 && view_test_sphere(view, ml->center, ml->radius) != VIEW_OUTSIDE) add_visible_meshlets(view, mesh, n, 1);
+        }
+        return;
+    }
+    for (int i = 0; i < mesh->num_meshlet_nodes;) { // Ascending meshlet order, like the plain loop above
+        const MeshletNode* node = &mesh->meshlet_nodes[i];
+        ViewOverlap overlap = node->radius < 0.0f ? VIEW_OUTSIDE : view_test_sphere(view, node->center, node->radius);
+        if (overlap == VIEW_PARTIAL && node->meshlet_count > 1) { ++i; continue; }
+        if (overlap != VIEW_OUTSIDE) add_visible_meshlets(view, mesh, node->first_meshlet, node->meshlet_count);
+        i = node->skip;
+    }
+}
+
+// Turns the visible meshlets' vertex ranges into disjoint spans of g_transform_spans. Returns the span count.
+static int collect_transform_spans(const RenderMesh* mesh) {
+    int* spans = g_transform_spans; int count = 0; bool sorted = true;
+    for (int n = 0; n < mesh->num_visible_meshlets; ++n) {
+        const Meshlet* ml = &mesh->meshlets[mesh->visible_meshlets[n]];
+        if (count > 0 && ml->first_vertex < spans[count * 2 - 2]) sorted = false;
+        spans[count * 2] = ml->first_vertex; spans[count * 2 + 1] = ml->first_vertex + ml->vertex_count; count++;
+    }
+    if (!sorted) qsort(spans, (size_t)count, 2 * sizeof(int), compare_ints); // By begin; only welded meshes reach back to older vertices
+    int merged = 0;
+    for (int n = 0; n < count; ++n) {
+        int begin = spans[n * 2], end = spans[n * 2 + 1];
+        int* last = merged > 0 ? &spans[merged * 2 - 2] : NULL;
+        if (last && begin < last[1]) { // Overlap: only the part past the previous span is new
+            if (end <= last[1]) continue;
+            begin = last[1];
+        }
+        if (last && begin == last[1] && last[1] - last[0] < TRANSFORM_BLOCK_VERTICES) { last[1] = end; continue; }
+        spans[merged * 2] = begin; spans[merged * 2 + 1] = end; merged++;
+    }
+    return merged;
+}
+
+// Projects mesh->original (or mesh->quantized) into mesh->transformed. A mesh with meshlets is culled first and only
+// the vertices of visible meshlets are projected; the rest of mesh->transformed is stale for this frame.
+static void transform_render_mesh(const ViewTransform* view, RenderMesh* mesh) {
+    if (mesh->meshlets && !reserve_meshlet_frame(mesh->num_meshlets)) mesh->meshlets = NULL; // Draw everything instead
+    if (!mesh->meshlets) {
+        if (mesh->quantized.x) transform_quantized_positions(view, &mesh->quantized, &mesh->transformed, mesh->num_vertices);
+        else transform_positions(view, &mesh->original, &mesh->transformed, mesh->num_vertices);
+        return;
+    }
+    mesh->visible_meshlets = g_visible_meshlets;
+    cull_meshlets(view, mesh);
+    int span_count = collect_transform_spans(mesh);
+    ViewTransform scaled;
+    TransformJob job = { view, &mesh->original, NULL, &mesh->transformed, 0, g_transform_spans };
+    if (mesh->quantized.x) { scaled = quantized_view_transform(view); job.view = &scaled; job.src = NULL; job.quantized_src = &mesh->quantized; }
+    parallel_for(span_count, transform_positions_job, &job);
+}
+
+// The renderers walk faces in ranges: the visible meshlets, or MESHLET_MAX_FACES slices of a mesh without meshlets.
+static int render_range_count(const RenderMesh* mesh) {
+    return mesh->meshlets ? mesh->num_visible_meshlets : (mesh->num_faces + MESHLET_MAX_FACES - 1) / MESHLET_MAX_FACES;
+}
+
+// Returns the first face of range n and stores the end (exclusive) in *end.
+static int render_range(const RenderMesh* mesh, int n, int* end) {
+    if (mesh->meshlets) {
+        const Meshlet* ml = &mesh->meshlets[mesh->visible_meshlets[n]];
+        *end = ml->first_face + ml->face_count; return ml->first_face;
+    }
+    int begin = n * MESHLET_MAX_FACES;
+    *end = begin + MESHLET_MAX_FACES < mesh->num_faces ? begin + MESHLET_MAX_FACES : mesh->num_faces;
+    return begin;
+}
+
+// --- Streaming Load ---
+// load_stl() normally runs on a background thread (see "Background Loading") so a big file shows up long before it is
+// fully parsed. The loaders hand each parsed batch of facets to the StlStream as raw file-space triangles, with batches
+// growing geometrically so the first one arrives almost at once, and the render loop turns them into a provisional
+// preview. The model globals belong to the loading thread until it reports done.
+#define STREAM_FIRST_BATCH_FACES 4096
+#define STREAM_MAX_BATCH_FACES (1 << 18)
+#define STREAM_ASCII_FIRST_WINDOW ((size_t)256 << 10) // Bytes of text in the first ASCII window
+#define STREAM_ASCII_MAX_WINDOW ((size_t)64 << 20)
+
+typedef struct StreamBatch {
+    struct StreamBatch* next;
+    Point3D* vertices; // Three per facet, in file units
+    int face_count;
+} StreamBatch;
+
+typedef struct {
+    ALLEGRO_THREAD* thread;
+    ALLEGRO_MUTEX* mutex;
+    char* filename;
+    // Shared with the loading thread, guarded by mutex
+    StreamBatch* head;
+    StreamBatch* tail;
+    uint64_t bytes_done, bytes_total;
+    bool finishing; // Parsing is over; welding, normals and the BVH are being built
+    bool done, ok;
+    // Render thread only
+    RenderMesh preview;           // Everything received so far, in provisional view units
+    int preview_capacity;         // Faces
+    Point3D min_coord, max_coord; // File-space bounds of the received facets
+    Point3D center; float scale;  // Normalization currently applied to preview.original
+    float progress;
+    bool shown_finishing, cancelled;
+    double start_time;
+} StlStream;
+
+StlStream g_stream;
+
+static bool stream_should_stop(StlStream* s) { return s && al_get_thread_should_stop(s->thread); }
+
+static void stream_begin(StlStream* s, uint64_t bytes_total) {
+    if (!s) return;
+    al_lock_mutex(s->mutex); s->bytes_total = bytes_total; al_unlock_mutex(s->mutex);
+}
+
+static void stream_report(StlStream* s, uint64_t bytes_done, bool finishing) {
+    if (!s) return;
+    al_lock_mutex(s->mutex); s->bytes_done = bytes_done; s->finishing = finishing; al_unlock_mutex(s->mutex);
+}
+
+// Copies face_count facets starting at vertex first_vertex of p into a batch for the render thread.
+static void stream_publish(StlStream* s, const VertexPositions* p, int first_vertex, int face_count, uint64_t bytes_done) {
+    if (!s || face_count <= 0) return;
+    StreamBatch* batch = (StreamBatch*)malloc(sizeof(StreamBatch));
+    Point3D* vertices = (Point3D*)malloc((size_t)face_count * 3 * sizeof(Point3D));
+    if (!batch || !vertices) { free(batch); free(vertices); stream_report(s, bytes_done, false); return; } // Only the preview misses them
+    for (int i = 0; i < face_count * 3; ++i) vertices[i] = (Point3D){ p->x[first_vertex + i], p->y[first_vertex + i], p->z[first_vertex + i] };
+    batch->next = NULL; batch->vertices = vertices; batch->face_count = face_count;
+    al_lock_mutex(s->mutex);
+    if (s->tail) s->tail->next = batch; else s->head = batch;
+    s->tail = batch; s->bytes_done = bytes_done;
+    al_unlock_mutex(s->mutex);
+}
+
+// Moves the (already grid-snapped) float positions into quantized_positions and frees them.
+static void compact_model_positions(void) {
+    if (!alloc_quantized_positions(&quantized_positions, num_vertices)) { app_log(true, "WARN", "Not enough memory for compact positions; keeping floats."); return; }
+    for (int i = 0; i < num_vertices; ++i) {
+        quantized_positions.x[i] = quantize_position(original_positions.x[i]);
+        quantized_positions.y[i] = quantize_position(original_positions.y[i]);
+        quantized_positions.z[i] = quantize_position(original_positions.z[i]);
+    }
+    free_vertex_positions(&original_positions);
+    app_log(false, "DEBUG", "Compact positions: %d vertices in %.1f MB instead of %.1f MB.", num_vertices,
+        num_vertices * 3.0 * sizeof(int16_t) / (1024.0 * 1024.0), num_vertices * 3.0 * sizeof(float) / (1024.0 * 1024.0));
+}
+
+// Re-centers and scales the loaded vertices into MODEL_VIEW_SIZE and assigns the Y gradient colors.
+static bool finalize_model_data(const char* filename, Point3D min_coord_pt, Point3D max_coord_pt) {
+    Point3D center_pt = { 0,0,0 }; float scale_factor = 1.0f; // Use Point3D for center
+    if (num_vertices > 0 && isfinite(min_coord_pt.x) && isfinite(max_coord_pt.x)) {
+        center_pt.x = (min_coord_pt.x + max_coord_pt.x) / 2.0f;
+        center_pt.y = (min_coord_pt.y + max_coord_pt.y) / 2.0f;
+        center_pt.z = (min_coord_pt.z + max_coord_pt.z) / 2.0f;
+        float extent_x = max_coord_pt.x - min_coord_pt.x; float extent_y = max_coord_pt.y - min_coord_pt.y; float extent_z = max_coord_pt.z - min_coord_pt.z;
+        float max_extent = fmaxf(extent_x, fmaxf(extent_y, extent_z));
+        if (max_extent > 1e-6f) scale_factor = MODEL_VIEW_SIZE / max_extent;
+    }
+    else if (num_vertices > 0) { app_log(true, "WARN", "Could not determine model bounds accurately."); }
+    g_model_center = center_pt; g_model_scale = scale_factor;
+
+    float min_y_orig = FLT_MAX; float max_y_orig = -FLT_MAX;
+    float* px = original_positions.x; float* py = original_positions.y; float* pz = original_positions.z;
+    for (int i = 0; i < num_vertices; ++i) {
+        px[i] = (px[i] - center_pt.x) * scale_factor;
+        py[i] = (py[i] - center_pt.y) * scale_factor;
+        pz[i] = (pz[i] - center_pt.z) * scale_factor;
+        if (py[i] < min_y_orig) min_y_orig = py[i];
+        if (py[i] > max_y_orig) max_y_orig = py[i];
+    }
+    if (g_weld_vertices) weld_model_vertices();
+    if (g_compact_positions) { // Normals and the BVH must see the positions the renderer will see
+        VertexPositions* p = &original_positions; // Welding reallocated the arrays px/py/pz point at
+        for (int i = 0; i < num_vertices; ++i) {
+            p->x[i] = dequantize_position(quantize_position(p->x[i]));
+            p->y[i] = dequantize_position(quantize_position(p->y[i]));
+            p->z[i] = dequantize_position(quantize_position(p->z[i]));
+        }
+    }
+    compute_face_normals(&original_positions, faces, num_faces, num_vertices);
+    build_meshlets(); // Reorders faces and vertices, so it goes before anything that stores their indices
+    build_meshlet_nodes();
+    build_bvh();
+
+    vertex_colors = (uint32_t*)malloc((size_t)num_vertices * sizeof(uint32_t));
+    if (!vertex_colors) { app_log(true, "ERROR", "Memory allocation failed for %d vertex colors.", num_vertices); free_loaded_model(); return false; }
+    uint32_t color_bottom = pack_rgba8(0, 0, 255, 255); uint32_t color_top = pack_rgba8(0, 255, 0, 255);
+    for (int i = 0; i < num_vertices; ++i) {
+        float t = 0.5f;
+        if ((max_y_orig - min_y_orig) > 1e-6f) { t = (original_positions.y[i] - min_y_orig) / (max_y_orig - min_y_orig); }
+        t = fminf(1.0f, fmaxf(0.0f, t));
+        vertex_colors[i] = color_lerp(color_bottom, color_top, t);
+    }
+    app_log(false, "DEBUG", "Vertex colors calculated based on Y range [%.2f, %.2f]", min_y_orig, max_y_orig);
+    if (g_compact_positions) compact_model_positions();
+    app_log(true, "INFO", "Successfully processed STL: %s, Faces: %d, Vertices: %d", filename, num_faces, num_vertices);
+    light_direction = vec_normalize((Point3D) { 0.5f, 0.5f, -1.0f });
+    return true;
+}
+
+// Decodes count 50-byte facet records into p from vertex first_vertex on and widens the bounds.
+static void stl_decode_binary_facets(const unsigned char* record, int count, VertexPositions* p, int first_vertex, Point3D* min_coord, Point3D* max_coord) {
+    Point3D lo = *min_coord, hi = *max_coord; // Locals, so the stores to p cannot alias them
+    for (int f = 0; f < count; ++f, record += STL_BINARY_FACET_SIZE) {
+        for (int k = 0; k < 3; ++k) {
+            const unsigned char* vp = record + 12 + k * 12; // Skip the stored normal
+            int vi = first_vertex + f * 3 + k;
+            float x = read_f32_le(vp), y = read_f32_le(vp + 4), z = read_f32_le(vp + 8);
+            p->x[vi] = x; p->y[vi] = y; p->z[vi] = z;
+            if (x < lo.x) lo.x = x;
+            if (y < lo.y) lo.y = y;
+            if (z < lo.z) lo.z = z;
+            if (x > hi.x) hi.x = x;
+            if (y > hi.y) hi.y = y;
+            if (z > hi.z) hi.z = z;
+        }
+    }
+    *min_coord = lo; *max_coord = hi;
+}
+
+// Reads 50-byte binary facet records straight out of the mapped file.
+static bool load_stl_binary(const char* filename, const unsigned char* data, size_t size, StlStream* stream) {
+    uint32_t header_facets = read_u32_le(data + 80);
+    uint64_t available_facets = (size - STL_BINARY_HEADER_SIZE) / STL_BINARY_FACET_SIZE;
+    if (header_facets > available_facets) {
+        app_log(true, "WARN", "Binary STL header claims %u facets but file only holds %llu. File may be truncated.", header_facets, (unsigned long long)available_facets);
+        header_facets = (uint32_t)available_facets;
+    }
+    if (header_facets == 0) { app_log(true, "ERROR", "No facets found in binary STL file '%s'.", filename); return false; }
+    if (header_facets > (uint32_t)(INT_MAX / 3)) { app_log(true, "ERROR", "Binary STL '%s' has too many facets (%u).", filename, header_facets); return false; }
+
+    num_faces = (int)header_facets;
+    num_vertices = num_faces * 3;
+    bool allocated = alloc_vertex_positions(&original_positions, num_vertices);
+    allocated = alloc_vertex_positions(&transformed_positions, num_vertices) && allocated;
+    faces = (Face*)malloc(num_faces * sizeof(Face));
+    if (!allocated || !faces) {
+        app_log(true, "ERROR", "Memory allocation failed for model data (%d faces, %d vertices).", num_faces, num_vertices);
+        free_loaded_model(); return false;
+    }
+    app_log(false, "DEBUG", "Binary STL: %d facets, memory allocated for %d vertices.", num_faces, num_vertices);
+
+    Point3D min_coord_pt = { FLT_MAX,FLT_MAX,FLT_MAX };
+    Point3D max_coord_pt = { -FLT_MAX,-FLT_MAX,-FLT_MAX };
+    const unsigned char* record = data + STL_BINARY_HEADER_SIZE;
+    int batch_faces = stream ? STREAM_FIRST_BATCH_FACES : num_faces;
+    for (int first = 0; first < num_faces; ) {
+        int last = num_faces - first > batch_faces ? first + batch_faces : num_faces;
+        stl_decode_binary_facets(record, last - first, &original_positions, first * 3, &min_coord_pt, &max_coord_pt);
+        for (int f = first; f < last; ++f) { faces[f].v_idx[0] = f * 3; faces[f].v_idx[1] = f * 3 + 1; faces[f].v_idx[2] = f * 3 + 2; }
+        record += (size_t)(last - first) * STL_BINARY_FACET_SIZE;
+        stream_publish(stream, &original_positions, first * 3, last - first, (uint64_t)(record - data));
+        if (stream_should_stop(stream)) { free_loaded_model(); return false; }
+        first = last;
+        if (batch_faces < STREAM_MAX_BATCH_FACES) batch_faces *= 2;
+    }
+    stream_report(stream, size, true);
+    return finalize_model_data(filename, min_coord_pt, max_coord_pt);
+}
+
+// --- ASCII STL Parsing ---
+// Exact powers of ten representable in a double; larger exponents fall back to pow().
+static const double k_pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool is_stl_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Hand-written replacement for sscanf("%f"). Parses [sign] digits [. digits] [e [sign] digits] starting at p
+// without reading past end. Returns the position after the number, or NULL if no number was found.
+static const char* scan_float(const char* p, const char* end, float* out) {
+    while (p < end && is_stl_space(*p)) p++;
+    if (p >= end) return NULL;
+    bool negative = false;
+    if (*p == '-' || *p == '+') { negative = (*p == '-'); p++; }
+
+    uint64_t mantissa = 0; int exponent = 0; int significant_digits = 0; bool any_digit = false;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (significant_digits < 19) { mantissa = mantissa * 10 + (uint64_t)(*p - '0'); if (mantissa) significant_digits++; }
+        else exponent++;
+        any_digit = true; p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (significant_digits < 19) { mantissa = mantissa * 10 + (uint64_t)(*p - '0'); exponent--; if (mantissa) significant_digits++; }
+            any_digit = true; p++;
+        }
+    }
+    if (!any_digit) {
+        // Not a plain decimal (e.g. "nan"/"inf"): let strtod deal with the rare odd token
+        char token[64]; int len = 0;
+        const char* q = p; if (negative) token[len++] = '-';
+        while (q < end && len < (int)sizeof(token) - 1 && !is_stl_space(*q) && *q != '\n') token[len++] = *q++;
+        token[len] = '\0';
+        char* token_end = NULL; double value = strtod(token, &token_end);
+        if (token_end == token || (negative && token_end == token + 1)) return NULL;
+        *out = (float)value; return p + (token_end - token) - (negative ? 1 : 0);
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* exp_start = p; p++;
+        bool exp_negative = false; int exp_value = 0; bool exp_digit = false;
+        if (p < end && (*p == '-' || *p == '+')) { exp_negative = (*p == '-'); p++; }
+        while (p < end && *p >= '0' && *p <= '9') { if (exp_value < 10000) exp_value = exp_value * 10 + (*p - '0'); exp_digit = true; p++; }
+        if (exp_digit) exponent += exp_negative ? -exp_value : exp_value;
+        else p = exp_start; // A lone 'e' is not part of the number
+    }
+
+    double value = (double)mantissa;
+    if (mantissa != 0) {
+        if (exponent >= 0 && exponent <= 22) value *= k_pow10_table[exponent];
+        else if (exponent < 0 && exponent >= -22) value /= k_pow10_table[-exponent];
+        else value *= pow(10.0, (double)exponent);
+    }
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+typedef enum { STL_WARN_EXTRA_VERTEX, STL_WARN_BAD_VERTEX, STL_WARN_SHORT_FACET } StlAsciiWarningKind;
+
+typedef struct {
+    const char* line_start; // The offending line; the text outlives the chunk until its warnings are logged
+    StlAsciiWarningKind kind;
+    int vertices, face;     // STL_WARN_SHORT_FACET: vertices collected, and the facet's index within the chunk
+} StlAsciiWarning;
+
+typedef struct {
+    Point3D* vertices;    // Three consecutive vertices per completed facet
+    int vertex_capacity;
+    int face_count;
+    Point3D min_coord;
+    Point3D max_coord;
+    bool out_of_memory;
+    StlAsciiWarning* warnings; // Logged by stl_log_ascii_warnings() once the chunk's place in the file is known
+    int warning_count, warning_capacity, warnings_dropped;
+} StlAsciiChunk;
+
+// Line numbers for warnings. text[0] is on line `line` (from 1); the cursor only moves forward, and only when a
+// warning needs a line number, so clean files never pay for counting and corrupt ones count each byte at most once.
+typedef struct {
+    const char* text;
+    long long line;
+} StlLineCursor;
+
+#define STL_WARNING_SNIPPET 80 // Characters of the offending line quoted in a parse warning
+
+static long long stl_line_cursor_advance(StlLineCursor* cursor, const char* to) {
+    for (const char* p = cursor->text; p < to && (p = (const char*)memchr(p, '\n', (size_t)(to - p))) != NULL; ++p) cursor->line++;
+    cursor->text = to;
+    return cursor->line;
+}
+
+// Length of the line at line_start to quote in a warning, without the line break, capped at STL_WARNING_SNIPPET.
+static int stl_ascii_snippet_length(const char* line_start, const char* end) {
+    int length = 0;
+    while (line_start + length < end && length < STL_WARNING_SNIPPET && line_start[length] != '\n' && line_start[length] != '\r') length++;
+    return length;
+}
+
+static void stl_chunk_warn(StlAsciiChunk* chunk, const char* line_start, StlAsciiWarningKind kind, int vertices) {
+    if (chunk->warning_count == chunk->warning_capacity) {
+        int new_capacity = chunk->warning_capacity > 0 ? chunk->warning_capacity * 2 : 16;
+        StlAsciiWarning* grown = chunk->warning_capacity < INT_MAX / 2 ? (StlAsciiWarning*)realloc(chunk->warnings, (size_t)new_capacity * sizeof(StlAsciiWarning)) : NULL;
+        if (!grown) { chunk->warnings_dropped++; return; }
+        chunk->warnings = grown; chunk->warning_capacity = new_capacity;
+    }
+    chunk->warnings[chunk->warning_count++] = (StlAsciiWarning){ line_start, kind, vertices, chunk->face_count };
+}
+
+// Logs a parsed chunk's warnings in file order. lines must not be past the chunk's start, end bounds the quoted
+// snippets, and first_face is the file-wide index of the chunk's first facet.
+static void stl_log_ascii_warnings(const StlAsciiChunk* chunk, StlLineCursor* lines, const char* end, int first_face) {
+    for (int i = 0; i < chunk->warning_count; ++i) {
+        const StlAsciiWarning* w = &chunk->warnings[i];
+        long long line = stl_line_cursor_advance(lines, w->line_start);
+        int snippet = stl_ascii_snippet_length(w->line_start, end);
+        if (w->kind == STL_WARN_EXTRA_VERTEX) app_log(true, "WARN", "Line %lld: Facet has more than 3 vertices. Ignoring: '%.*s'", line, snippet, w->line_start);
+        else if (w->kind == STL_WARN_BAD_VERTEX) app_log(true, "WARN", "Line %lld: Failed to parse 3 floats for vertex from: '%.*s'", line, snippet, w->line_start);
+        else app_log(true, "ERROR", "Line %lld: Not enough vertices (%d) to form face %d. STL might be corrupt.", line, w->vertices, first_face + w->face);
+    }
+    if (chunk->warnings_dropped > 0) app_log(true, "WARN", "%d more parse warnings were lost (out of memory).", chunk->warnings_dropped);
+}
+
+static bool stl_chunk_reserve(StlAsciiChunk* chunk, int face_capacity) {
+    if (face_capacity * 3 <= chunk->vertex_capacity) return true;
+    int new_capacity = chunk->vertex_capacity > 0 ? chunk->vertex_capacity : 3 * 1024;
+    while (new_capacity < face_capacity * 3) {
+        if (new_capacity > INT_MAX / 2) { new_capacity = INT_MAX / 3 * 3; break; }
+        new_capacity *= 2;
+    }
+    if (new_capacity < face_capacity * 3) { chunk->out_of_memory = true; return false; }
+    Point3D* grown = (Point3D*)realloc(chunk->vertices, (size_t)new_capacity * sizeof(Point3D));
+    if (!grown) { chunk->out_of_memory = true; return false; }
+    chunk->vertices = grown; chunk->vertex_capacity = new_capacity;
+    return true;
+}
+
+// Single pass over [begin, end): every "vertex" line goes straight into the chunk's vertex array and bounds,
+// and "endfacet" commits the current facet if it collected at least three vertices. Problems are recorded in the
+// chunk rather than logged, since only the caller knows where the chunk sits in the file.
+static void parse_stl_ascii_range(const char* begin, const char* end, size_t size_hint, StlAsciiChunk* chunk) {
+    chunk->warning_count = chunk->warnings_dropped = 0;
+    chunk->min_coord = (Point3D){ FLT_MAX, FLT_MAX, FLT_MAX };
+    chunk->max_coord = (Point3D){ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    // A typical exported facet takes ~250 bytes of text; start near that and grow geometrically from there
+    if (!stl_chunk_reserve(chunk, (int)fmin((double)(size_hint / 256 + 16), (double)(INT_MAX / 3)))) return;
+
+    int facet_vertices = 0;
+    const char* p = begin;
+    while (p < end) {
+        while (p < end && (is_stl_space(*p) || *p == '\n')) p++;
+        if (p >= end) break;
+        const char* line_start = p;
+        size_t remaining = (size_t)(end - p);
+
+        if (*p == 'v' && remaining >= 6 && memcmp(p, "vertex", 6) == 0) {
+            Point3D temp_p; const char* q = p + 6;
+            if ((q = scan_float(q, end, &temp_p.x)) && (q = scan_float(q, end, &temp_p.y)) && (q = scan_float(q, end, &temp_p.z))) {
+                if (facet_vertices < 3) {
+                    if (facet_vertices == 0 && !stl_chunk_reserve(chunk, chunk->face_count + 1)) return;
+                    chunk->vertices[chunk->face_count * 3 + facet_vertices] = temp_p;
+                    if (temp_p.x < chunk->min_coord.x) chunk->min_coord.x = temp_p.x;
+                    if (temp_p.y < chunk->min_coord.y) chunk->min_coord.y = temp_p.y;
+                    if (temp_p.z < chunk->min_coord.z) chunk->min_coord.z = temp_p.z;
+                    if (temp_p.x > chunk->max_coord.x) chunk->max_coord.x = temp_p.x;
+                    if (temp_p.y > chunk->max_coord.y) chunk->max_coord.y = temp_p.y;
+                    if (temp_p.z > chunk->max_coord.z) chunk->max_coord.z = temp_p.z;
+                }
+                else { stl_chunk_warn(chunk, line_start, STL_WARN_EXTRA_VERTEX, facet_vertices); }
+                facet_vertices++;
+            }
+            else { stl_chunk_warn(chunk, line_start, STL_WARN_BAD_VERTEX, facet_vertices); }
+        }
+        else if (*p == 'e' && remaining >= 8 && memcmp(p, "endfacet", 8) == 0) {
+            if (facet_vertices >= 3) chunk->face_count++;
+            else { stl_chunk_warn(chunk, line_start, STL_WARN_SHORT_FACET, facet_vertices); }
+            facet_vertices = 0;
+        }
+        else if (*p == 'f' && remaining >= 5 && memcmp(p, "facet", 5) == 0) {
+            facet_vertices = 0;
+        }
+        const char* line_end = (const char*)memchr(p, '\n', (size_t)(end - p));
+        p = line_end ? line_end + 1 : end;
+    }
+}
+
+#define STL_PARALLEL_MIN_BYTES (4u << 20) // Below this a single pass is already fast enough
+#define STL_CHUNKS_PER_THREAD 4           // Extra chunks even out facets of uneven length
+
+// Moves pos forward to the start of the next line that begins a facet ("facet normal ..."), so a chunk never
+// splits a facet. Returns end if there is none.
+static const char* stl_align_to_facet(const char* pos, const char* end) {
+    while (pos < end) {
+        const char* line_end = (const char*)memchr(pos, '\n', (size_t)(end - pos));
+        if (!line_end) return end;
+        const char* p = line_end + 1;
+        while (p < end && is_stl_space(*p)) p++;
+        if ((size_t)(end - p) >= 5 && memcmp(p, "facet", 5) == 0) return line_end + 1;
+        pos = line_end + 1;
+    }
+    return end;
+}
+
+typedef struct {
+    const char** bounds;       // chunk_count + 1 byte boundaries
+    StlAsciiChunk* chunks;
+    VertexPositions positions; // Merged output, vertices in file order
+    int* first_face;           // Prefix sums of chunk face counts
+} StlParallelParse;
+
+static void stl_parse_chunk_job(void* context, int job_index) {
+    StlParallelParse* job = (StlParallelParse*)context;
+    const char* begin = job->bounds[job_index]; const char* end = job->bounds[job_index + 1];
+    parse_stl_ascii_range(begin, end, (size_t)(end - begin), &job->chunks[job_index]);
+}
+
+// Scatters one chunk's interleaved points into the merged x/y/z arrays at the chunk's face offset.
+static void stl_merge_chunk_job(void* context, int job_index) {
+    StlParallelParse* job = (StlParallelParse*)context;
+    StlAsciiChunk* chunk = &job->chunks[job_index];
+    int base = job->first_face[job_index] * 3;
+    for (int i = 0; i < chunk->face_count * 3; ++i) {
+        job->positions.x[base + i] = chunk->vertices[i].x;
+        job->positions.y[base + i] = chunk->vertices[i].y;
+        job->positions.z[base + i] = chunk->vertices[i].z;
+    }
+    free(chunk->vertices); chunk->vertices = NULL;
+}
+
+// Parses the file in facet-aligned byte ranges on the worker pool (one range for small files), then merges the
+// per-chunk vertices in file order into positions and combines their bounds, so the result is identical to a
+// single pass. Warnings are logged in file order afterwards, with line numbers from lines and face numbers counted
+// from first_face. Returns false only when memory ran out.
+static bool parse_stl_ascii_parallel(StlLineCursor* lines, int first_face, const char* text, size_t size, VertexPositions* positions, int* face_count, Point3D* min_coord, Point3D* max_coord) {
+    positions->x = positions->y = positions->z = NULL; *face_count = 0;
+    int chunk_count = size < STL_PARALLEL_MIN_BYTES ? 1 : worker_pool_size() * STL_CHUNKS_PER_THREAD;
+    if (chunk_count > 1 && (size_t)chunk_count > size / (STL_PARALLEL_MIN_BYTES / 16)) chunk_count = (int)(size / (STL_PARALLEL_MIN_BYTES / 16));
+
+    StlParallelParse job; memset(&job, 0, sizeof(job));
+    job.bounds = (const char**)malloc((size_t)(chunk_count + 1) * sizeof(const char*));
+    job.chunks = (StlAsciiChunk*)calloc((size_t)chunk_count, sizeof(StlAsciiChunk));
+    job.first_face = (int*)malloc((size_t)(chunk_count + 1) * sizeof(int));
+    if (!job.bounds || !job.chunks || !job.first_face) { free(job.bounds); free(job.chunks); free(job.first_face); return false; }
+    job.bounds[0] = text; job.bounds[chunk_count] = text + size;
+    for (int i = 1; i < chunk_count; ++i) {
+        const char* nominal = text + (size / (size_t)chunk_count) * (size_t)i;
+        if (nominal < job.bounds[i - 1]) nominal = job.bounds[i - 1];
+        job.bounds[i] = stl_align_to_facet(nominal, text + size);
+    }
+    parallel_for(chunk_count, stl_parse_chunk_job, &job);
+
+    *min_coord = (Point3D){ FLT_MAX, FLT_MAX, FLT_MAX };
+    *max_coord = (Point3D){ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    long long total_faces = 0; bool out_of_memory = false;
+    for (int i = 0; i < chunk_count; ++i) {
+        StlAsciiChunk* c = &job.chunks[i];
+        job.first_face[i] = (int)total_faces;
+        total_faces += c->face_count;
+        if (c->out_of_memory) out_of_memory = true;
+        min_coord->x = fminf(min_coord->x, c->min_coord.x); max_coord->x = fmaxf(max_coord->x, c->max_coord.x);
+        min_coord->y = fminf(min_coord->y, c->min_coord.y); max_coord->y = fmaxf(max_coord->y, c->max_coord.y);
+        min_coord->z = fminf(min_coord->z, c->min_coord.z); max_coord->z = fmaxf(max_coord->z, c->max_coord.z);
+        stl_log_ascii_warnings(c, lines, text + size, first_face + job.first_face[i]);
+        free(c->warnings); c->warnings = NULL;
+    }
+    if (total_faces > INT_MAX / 3) out_of_memory = true;
+    if (!out_of_memory && total_faces > 0 && !alloc_vertex_positions(&job.positions, (int)total_faces * 3)) out_of_memory = true;
+    if (!out_of_memory && total_faces > 0) parallel_for(chunk_count, stl_merge_chunk_job, &job);
+    else { for (int i = 0; i < chunk_count; ++i) free(job.chunks[i].vertices); }
+    if (!out_of_memory) { *positions = job.positions; *face_count = (int)total_faces; }
+    if (chunk_count > 1) app_log(false, "DEBUG", "ASCII STL parsed in %d chunks on %d threads.", chunk_count, worker_pool_size());
+    free(job.bounds); free(job.chunks); free(job.first_face);
+    return !out_of_memory;
+}
+
+typedef struct {
+    int faces, vertex_capacity; // Facets appended to original_positions so far, and its capacity in vertices
+    Point3D min_coord, max_coord;
+} StlAsciiLoad;
+
+// Parses one facet-aligned window of text on the worker pool and appends its facets to original_positions. lines
+// numbers the window's warnings and bytes_done is the progress reported to the stream. Returns false only when
+// memory ran out.
+static bool stl_ascii_append_window(StlAsciiLoad* load, StlLineCursor* lines, const char* text, size_t size, StlStream* stream, uint64_t bytes_done) {
+    VertexPositions window_positions; Point3D window_min, window_max; int window_faces = 0;
+    if (!parse_stl_ascii_parallel(lines, load->faces, text, size, &window_positions, &window_faces, &window_min, &window_max)) return false;
+    stream_publish(stream, &window_positions, 0, window_faces, bytes_done);
+    if (load->faces == 0) { free_vertex_positions(&original_positions); original_positions = window_positions; load->vertex_capacity = window_faces * 3; }
+    else {
+        bool grown = window_faces <= INT_MAX / 3 - load->faces && grow_vertex_positions(&original_positions, load->faces * 3, &load->vertex_capacity, (load->faces + window_faces) * 3);
+        if (grown) {
+            memcpy(original_positions.x + load->faces * 3, window_positions.x, (size_t)window_faces * 3 * sizeof(float));
+            memcpy(original_positions.y + load->faces * 3, window_positions.y, (size_t)window_faces * 3 * sizeof(float));
+            memcpy(original_positions.z + load->faces * 3, window_positions.z, (size_t)window_faces * 3 * sizeof(float));
+        }
+        free_vertex_positions(&window_positions);
+        if (!grown) return false;
+    }
+    if (window_faces > 0) {
+        load->faces += window_faces;
+        load->min_coord.x = fminf(load->min_coord.x, window_min.x); load->max_coord.x = fmaxf(load->max_coord.x, window_max.x);
+        load->min_coord.y = fminf(load->min_coord.y, window_min.y); load->max_coord.y = fmaxf(load->max_coord.y, window_max.y);
+        load->min_coord.z = fminf(load->min_coord.z, window_min.z); load->max_coord.z = fmaxf(load->max_coord.z, window_max.z);
+    }
+    return true;
+}
+
+// Turns face_count facets already in original_positions (three vertices each, in order) into the model and
+// finalizes it. bytes_total is the final progress reported to the stream.
+static bool stl_finish_facet_soup(const char* filename, int face_count, Point3D min_coord_pt, Point3D max_coord_pt, StlStream* stream, uint64_t bytes_total) {
+    if (face_count == 0) { app_log(true, "ERROR", "No facets found in STL file '%s'.", filename); free_vertex_positions(&original_positions); return false; }
+    num_faces = face_count;
+    num_vertices = num_faces * 3;
+    bool allocated = alloc_vertex_positions(&transformed_positions, num_vertices);
+    faces = (Face*)malloc(num_faces * sizeof(Face));
+    if (!allocated || !faces) {
+        app_log(true, "ERROR", "Memory allocation failed for model data (%d faces, %d vertices).", num_faces, num_vertices);
+        free_loaded_model(); return false;
+    }
+    for (int i = 0; i < num_faces; ++i) {
+        faces[i].v_idx[0] = i * 3 + 0; faces[i].v_idx[1] = i * 3 + 1; faces[i].v_idx[2] = i * 3 + 2;
+    }
+    app_log(false, "DEBUG", "Parsed %d facets.", num_faces);
+    stream_report(stream, bytes_total, true);
+    return finalize_model_data(filename, min_coord_pt, max_coord_pt);
+}
+
+// Parses the text in facet-aligned windows: the whole file at once, or doubling windows when streaming so the first
+// facets can be shown after a fraction of a second. Each window is parsed on the worker pool and appended in order.
+static bool load_stl_ascii(const char* filename, const unsigned char* data, size_t size, StlStream* stream) {
+    app_log(true, "INFO", "Attempting to load STL file: %s", filename);
+    const char* text = (const char*)data; const char* text_end = text + size;
+    StlAsciiLoad load = { 0, 0, { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+    size_t window = stream ? STREAM_ASCII_FIRST_WINDOW : size;
+    StlLineCursor lines = { text, 1 }; // The whole file is mapped, so one cursor serves every window
+    for (const char* pos = text; pos < text_end; ) {
+        const char* window_end = (size_t)(text_end - pos) <= window ? text_end : stl_align_to_facet(pos + window, text_end);
+        if (!stl_ascii_append_window(&load, &lines, pos, (size_t)(window_end - pos), stream, (uint64_t)(window_end - text))) {
+            app_log(true, "ERROR", "Memory allocation failed while parsing '%s'.", filename); free_vertex_positions(&original_positions); return false;
+        }
+        if (stream_should_stop(stream)) { free_vertex_positions(&original_positions); return false; }
+        pos = window_end;
+        if (stream && window < STREAM_ASCII_MAX_WINDOW) window *= 2;
+    }
+    return stl_finish_facet_soup(filename, load.faces, load.min_coord, load.max_coord, stream, size);
+}
+
+// --- Compressed Input ---
+// gzip (.stl.gz) and zstd (.stl.zst) files, recognized by their magic bytes rather than the name, are decoded while
+// they are parsed: the mapped compressed file is fed through the decoder into a bounded buffer that the binary or
+// ASCII parser drains window by window, so nothing is written to a temporary file and the disk only reads the
+// compressed bytes. Both libraries are optional: build with -DSTL_VIEWER_WITH_ZLIB (link zlib) and/or
+// -DSTL_VIEWER_WITH_ZSTD (link libzstd). Progress is reported in compressed bytes.
+#define STL_DECODE_CHUNK_BYTES ((size_t)4 << 20)   // Decoded bytes per binary batch
+#define STL_DECODE_ASCII_WINDOW ((size_t)32 << 20) // Decoded text per ASCII window when not streaming
+#define STL_DECODE_MAX_RATIO 1100                   // Deflate tops out near 1032:1; a facet count beyond it is not preallocated
+
+typedef enum { STL_CODEC_NONE, STL_CODEC_GZIP, STL_CODEC_ZSTD } StlCodec;
+static const char* const k_stl_codec_names[] = { "uncompressed", "gzip", "zstd" };
+
+typedef struct {
+    StlCodec codec;
+    const unsigned char* in; size_t in_size, in_pos; // The mapped compressed file
+    unsigned char* out; size_t out_filled, out_capacity; // Decoded bytes not yet consumed by the parser
+    uint64_t out_offset;                                  // Decoded-file offset of out[0]
+    bool at_end, failed;
+#ifdef STL_VIEWER_WITH_ZLIB
+    z_stream zlib; bool zlib_ready;
+#endif
+#ifdef STL_VIEWER_WITH_ZSTD
+    ZSTD_DStream* zstd;
+#endif
+} StlDecoder;
+
+// A file whose size matches its binary STL header is never taken for compressed, whatever its first bytes are.
+static StlCodec stl_detect_codec(const unsigned char* data, size_t size) {
+    if (size >= STL_BINARY_HEADER_SIZE && STL_BINARY_HEADER_SIZE + (uint64_t)read_u32_le(data + 80) * STL_BINARY_FACET_SIZE == (uint64_t)size) return STL_CODEC_NONE;
+    if (size >= 2 && data[0] == 0x1F && data[1] == 0x8B) return STL_CODEC_GZIP;
+    if (size >= 4 && data[0] == 0x28 && data[1] == 0xB5 && data[2] == 0x2F && data[3] == 0xFD) return STL_CODEC_ZSTD;
+    return STL_CODEC_NONE;
+}
+
+static void stl_decoder_close(StlDecoder* d) {
+#ifdef STL_VIEWER_WITH_ZLIB
+    if (d->zlib_ready) inflateEnd(&d->zlib);
+#endif
+#ifdef STL_VIEWER_WITH_ZSTD
+    if (d->zstd) ZSTD_freeDStream(d->zstd);
+#endif
+    free(d->out);
+    memset(d, 0, sizeof(*d));
+}
+
+// Returns false when this build has no decoder for the codec or it fails to start.
+static bool stl_decoder_open(StlDecoder* d, StlCodec codec, const unsigned char* data, size_t size) {
+    memset(d, 0, sizeof(*d));
+    d->codec = codec; d->in = data; d->in_size = size;
+#ifdef STL_VIEWER_WITH_ZLIB
+    if (codec == STL_CODEC_GZIP) { d->zlib_ready = inflateInit2(&d->zlib, 15 + 16) == Z_OK; return d->zlib_ready; } // 16: gzip wrapper
+#endif
+#ifdef STL_VIEWER_WITH_ZSTD
+    if (codec == STL_CODEC_ZSTD) { d->zstd = ZSTD_createDStream(); return d->zstd && !ZSTD_isError(ZSTD_initDStream(d->zstd)); }
+#endif
+    return false;
+}
+
+// One decoder call into the free end of out. Sets at_end after the last member or frame, failed on corrupt or
+// truncated input.
+static void stl_decoder_step(StlDecoder* d) {
+    size_t space = d->out_capacity - d->out_filled;
+#ifdef STL_VIEWER_WITH_ZLIB
+    if (d->codec == STL_CODEC_GZIP) {
+        const size_t max_step = (size_t)1 << 30; // avail_in/avail_out are 32-bit
+        size_t in_left = d->in_size - d->in_pos;
+        d->zlib.next_in = (Bytef*)(d->in + d->in_pos); d->zlib.avail_in = (uInt)(in_left < max_step ? in_left : max_step);
+        d->zlib.next_out = d->out + d->out_filled; d->zlib.avail_out = (uInt)(space < max_step ? space : max_step);
+        int rc = inflate(&d->zlib, Z_NO_FLUSH);
+        d->in_pos = (size_t)(d->zlib.next_in - d->in); d->out_filled = (size_t)(d->zlib.next_out - d->out);
+        if (rc == Z_STREAM_END) { // Another member may follow (concatenated .gz); anything else is trailing padding
+            if (d->in_size - d->in_pos >= 2 && d->in[d->in_pos] == 0x1F && d->in[d->in_pos + 1] == 0x8B) inflateReset(&d->zlib);
+            else d->at_end = true;
+        }
+        else if (rc != Z_OK && !(rc == Z_BUF_ERROR && d->in_pos < d->in_size)) d->failed = true; // Z_BUF_ERROR with no input left: truncated
+    }
+#endif
+#ifdef STL_VIEWER_WITH_ZSTD
+    if (d->codec == STL_CODEC_ZSTD) {
+        ZSTD_inBuffer in = { d->in + d->in_pos, d->in_size - d->in_pos, 0 };
+        ZSTD_outBuffer out = { d->out + d->out_filled, space, 0 };
+        size_t rc = ZSTD_decompressStream(d->zstd, &out, &in);
+        d->in_pos += in.pos; d->out_filled += out.pos;
+        if (ZSTD_isError(rc)) d->failed = true;
+        else if (d->in_pos == d->in_size && out.pos < out.size) { // Input used up and nothing left to flush
+            if (rc == 0) d->at_end = true; // Between frames
+            else d->failed = true;
+        }
+    }
+#endif
+    (void)space;
+}
+
+// Decodes until at least want bytes are waiting in out or the input ends. Returns false (after logging) on corrupt
+// input or when the buffer cannot grow.
+static bool stl_decoder_fill(StlDecoder* d, const char* filename, size_t want) {
+    if (want > d->out_capacity) {
+        unsigned char* grown = (unsigned char*)realloc(d->out, want);
+        if (!grown) { app_log(true, "ERROR", "Memory allocation failed for a %zu-byte decode buffer.", want); return false; }
+        d->out = grown; d->out_capacity = want;
+    }
+    while (d->out_filled < want && !d->at_end && !d->failed) stl_decoder_step(d);
+    if (d->failed) { app_log(true, "ERROR", "'%s': %s data is corrupt or truncated near compressed byte %zu.", filename, k_stl_codec_names[d->codec], d->in_pos); return false; }
+    return true;
+}
+
+// Drops the first count decoded bytes once the parser is done with them.
+static void stl_decoder_consume(StlDecoder* d, size_t count) {
+    memmove(d->out, d->out + count, d->out_filled - count);
+    d->out_filled -= count; d->out_offset += count;
+}
+
+// Binary facets are decoded in batches of up to STL_DECODE_CHUNK_BYTES (growing from STREAM_FIRST_BATCH_FACES when
+// streaming) and appended to original_positions.
+static bool load_stl_binary_decoded(const char* filename, StlDecoder* d, StlStream* stream) {
+    if (!stl_decoder_fill(d, filename, STL_BINARY_HEADER_SIZE)) return false;
+    if (d->out_filled < STL_BINARY_HEADER_SIZE) { app_log(true, "ERROR", "Binary STL '%s' is too short for its header.", filename); return false; }
+    uint32_t header_facets = read_u32_le(d->out + 80);
+    if (header_facets > (uint32_t)(INT_MAX / 3)) { app_log(true, "ERROR", "Binary STL '%s' has too many facets (%u).", filename, header_facets); return false; }
+    stl_decoder_consume(d, STL_BINARY_HEADER_SIZE);
+
+    Point3D min_coord_pt = { FLT_MAX, FLT_MAX, FLT_MAX }, max_coord_pt = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    int parsed_faces = 0, vertex_capacity = 0;
+    bool trusted = (uint64_t)header_facets * STL_BINARY_FACET_SIZE <= (uint64_t)d->in_size * STL_DECODE_MAX_RATIO;
+    bool ok = !trusted || header_facets == 0 || grow_vertex_positions(&original_positions, 0, &vertex_capacity, (int)header_facets * 3);
+    size_t batch_bytes = stream ? (size_t)STREAM_FIRST_BATCH_FACES * STL_BINARY_FACET_SIZE : STL_DECODE_CHUNK_BYTES;
+    while (ok && parsed_faces < (int)header_facets) {
+        if (!(ok = stl_decoder_fill(d, filename, batch_bytes))) break;
+        if (batch_bytes < STL_DECODE_CHUNK_BYTES) batch_bytes *= 2;
+        int count = (int)(d->out_filled / STL_BINARY_FACET_SIZE);
+        if (count > (int)header_facets - parsed_faces) count = (int)header_facets - parsed_faces;
+        if (count == 0) break; // Data ended early
+        if (!grow_vertex_positions(&original_positions, parsed_faces * 3, &vertex_capacity, (parsed_faces + count) * 3)) {
+            app_log(true, "ERROR", "Memory allocation failed while parsing '%s'.", filename); ok = false; break;
+        }
+        stl_decode_binary_facets(d->out, count, &original_positions, parsed_faces * 3, &min_coord_pt, &max_coord_pt);
+        stream_publish(stream, &original_positions, parsed_faces * 3, count, d->in_pos);
+        parsed_faces += count;
+        stl_decoder_consume(d, (size_t)count * STL_BINARY_FACET_SIZE);
+        if (stream_should_stop(stream)) ok = false;
+    }
+    if (!ok) { free_vertex_positions(&original_positions); return false; }
+    if ((uint32_t)parsed_faces < header_facets)
+        app_log(true, "WARN", "Binary STL header claims %u facets but the decoded data only holds %d. File may be truncated.", header_facets, parsed_faces);
+    return stl_finish_facet_soup(filename, parsed_faces, min_coord_pt, max_coord_pt, stream, d->in_size);
+}
+
+// Start of the last line in [begin, end) that begins a facet, or begin if there is none; the text before it holds
+// only whole facets.
+static const char* stl_last_facet_start(const char* begin, const char* end) {
+    for (const char* p = end; p > begin; ) {
+        if (*--p != '\n') continue;
+        const char* q = p + 1;
+        while (q < end && is_stl_space(*q)) q++;
+        if ((size_t)(end - q) >= 5 && memcmp(q, "facet", 5) == 0) return p + 1;
+    }
+    return begin;
+}
+
+// ASCII text is decoded into a window, parsed up to its last facet start like load_stl_ascii() does, and the
+// unfinished facet carried over to the next window.
+static bool load_stl_ascii_decoded(const char* filename, StlDecoder* d, StlStream* stream) {
+    StlAsciiLoad load = { 0, 0, { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+    size_t window = stream ? STREAM_ASCII_FIRST_WINDOW : STL_DECODE_ASCII_WINDOW;
+    StlLineCursor lines = { NULL, 1 }; // Decoded text is dropped once parsed, so the cursor is moved past each window
+    for (;;) {
+        if (!stl_decoder_fill(d, filename, window)) { free_vertex_positions(&original_positions); return false; }
+        if (d->out_filled == 0) break;
+        const char* text = (const char*)d->out; const char* text_end = text + d->out_filled;
+        const char* window_end = d->at_end ? text_end : stl_last_facet_start(text, text_end);
+        if (window_end == text) { window *= 2; continue; } // Not even one whole facet yet
+        lines.text = text;
+        if (!stl_ascii_append_window(&load, &lines, text, (size_t)(window_end - text), stream, d->in_pos)) {
+            app_log(true, "ERROR", "Memory allocation failed while parsing '%s'.", filename); free_vertex_positions(&original_positions); return false;
+        }
+        stl_line_cursor_advance(&lines, window_end);
+        stl_decoder_consume(d, (size_t)(window_end - text));
+        if (stream_should_stop(stream)) { free_vertex_positions(&original_positions); return false; }
+        if (stream && window < STREAM_ASCII_MAX_WINDOW) window *= 2;
+    }
+    return stl_finish_facet_soup(filename, load.faces, load.min_coord, load.max_coord, stream, d->in_size);
+}
+
+// Decodes the start of the file to tell binary from ASCII with the same text probe as uncompressed files (the
+// decoded size is unknown up front, so the header size check cannot be used), then streams the rest into the parser.
+static bool load_stl_compressed(const char* filename, StlCodec codec, const unsigned char* data, size_t size, StlStream* stream) {
+    StlDecoder d;
+    if (!stl_decoder_open(&d, codec, data, size)) {
+        const char* macro = codec == STL_CODEC_GZIP ? "STL_VIEWER_WITH_ZLIB" : "STL_VIEWER_WITH_ZSTD";
+        app_log(true, "ERROR", "'%s' is %s-compressed, but this build cannot decode it (build with %s).", filename, k_stl_codec_names[codec], macro);
+        stl_decoder_close(&d); return false;
+    }
+    bool ok = stl_decoder_fill(&d, filename, STL_TEXT_PROBE_BYTES);
+    if (ok) {
+        bool is_binary = stl_probe_is_binary(d.out, d.out_filled);
+        app_log(true, "INFO", "Attempting to load %s-compressed %s STL file: %s", k_stl_codec_names[codec], is_binary ? "binary" : "ASCII", filename);
+        ok = is_binary ? load_stl_binary_decoded(filename, &d, stream) : load_stl_ascii_decoded(filename, &d, stream);
+        if (ok) app_log(false, "DEBUG", "Decoded %llu bytes from %zu compressed (%.1fx).", (unsigned long long)(d.out_offset + d.out_filled), size, (double)(d.out_offset + d.out_filled) / (double)size);
+    }
+    stl_decoder_close(&d);
+    return ok;
+}
+
+// --- Mesh Cache ---
+// With --cache, after a successful parse the processed model (normalized positions, gradient colors, faces with
+// normals and the picking BVH) is written next to the STL as "<file>.meshcache". It is opt-in because models often
+// sit on read-only or shared folders. Later opens of the same path with the same size and sub-second modification
+// time map that file and point the model arrays straight into it, skipping parsing, welding,
+// normalization and the BVH build. The layout is raw host structs; MESH_CACHE_VERSION must be bumped whenever
+// Face, the color format, BvhNode or the section list changes, and the layout word catches compiler differences.
+#define MESH_CACHE_MAGIC "STLVMC\r\n" // The CR/LF pair exposes text-mode mangling
+#define MESH_CACHE_VERSION 4 // 2: packed RGBA8 colors, 3: optional 16-bit positions, 4: meshlets
+#define MESH_CACHE_SUFFIX ".meshcache"
+#define MESH_CACHE_ALIGN 64
+#define MESH_CACHE_WELDED 1u
+#define MESH_CACHE_COMPACT 2u // Position sections hold int16_t grid coordinates instead of floats
+
+static uint32_t mesh_cache_flags(void) { return (g_weld_vertices ? MESH_CACHE_WELDED : 0) | (g_compact_positions ? MESH_CACHE_COMPACT : 0); }
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout; // sizeof(Face) | sizeof(vertex color) << 8 | sizeof(BvhNode) << 16 | sizeof(Meshlet) << 24
+    uint64_t source_size;
+    int64_t source_mtime; // See stat_source_file()
+    uint32_t flags;
+    int32_t num_vertices;
+    int32_t num_faces;
+    int32_t bvh_node_count;
+    float center[3];
+    float scale;
+    uint32_t path_length;
+    int32_t num_meshlets;
+    uint64_t path_offset, x_offset, y_offset, z_offset, colors_offset, faces_offset, bvh_nodes_offset, bvh_index_offset, meshlets_offset;
+    uint64_t file_size;
+} MeshCacheHeader;
+
+
+static uint32_t mesh_cache_layout(void) {
+    return (uint32_t)sizeof(Face) | (uint32_t)sizeof(*vertex_colors) << 8 | (uint32_t)sizeof(BvhNode) << 16 | (uint32_t)sizeof(Meshlet) << 24;
+}
+static uint64_t mesh_cache_align(uint64_t offset) { return (offset + MESH_CACHE_ALIGN - 1) & ~(uint64_t)(MESH_CACHE_ALIGN - 1); }
+
+// Size and modification time of path. The time is in 100 ns ticks on Windows and nanoseconds elsewhere, so a file
+// rewritten within the same second still reads as changed.
+static bool stat_source_file(const char* path, uint64_t* size, int64_t* mtime) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes)) return false;
+    *size = (uint64_t)attributes.nFileSizeHigh << 32 | attributes.nFileSizeLow;
+    *mtime = (int64_t)((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32 | attributes.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+#ifdef __APPLE__
+    struct timespec modified = st.st_mtimespec;
+#else
+    struct timespec modified = st.st_mtim;
+#endif
+    *size = (uint64_t)st.st_size; *mtime = (int64_t)modified.tv_sec * 1000000000 + modified.tv_nsec;
+#endif
+    return true;
+}
+
+static char* mesh_cache_path(const char* filename) {
+    size_t length = strlen(filename);
+    char* path = (char*)malloc(length + sizeof(MESH_CACHE_SUFFIX) + 4);
+    if (path) { memcpy(path, filename, length); memcpy(path + length, MESH_CACHE_SUFFIX, sizeof(MESH_CACHE_SUFFIX)); }
+    return path;
+}
+
+// Lays out the sections after the header. Returns the total file size.
+static uint64_t mesh_cache_plan(MeshCacheHeader* h) {
+    uint64_t offset = mesh_cache_align(sizeof(MeshCacheHeader));
+    uint64_t position_size = (h->flags & MESH_CACHE_COMPACT) ? sizeof(int16_t) : sizeof(float);
+    h->path_offset = offset; offset = mesh_cache_align(offset + h->path_length + 1);
+    h->x_offset = offset; offset = mesh_cache_align(offset + (uint64_t)h->num_vertices * position_size);
+    h->y_offset = offset; offset = mesh_cache_align(offset + (uint64_t)h->num_vertices * position_size);
+    h->z_offset = offset; offset = mesh_cache_align(offset + (uint64_t)h->num_vertices * position_size);
+    h->colors_offset = offset; offset = mesh_cache_align(offset + (uint64_t)h->num_vertices * sizeof(*vertex_colors));
+    h->faces_offset = offset; offset = mesh_cache_align(offset + (uint64_t)h->num_faces * sizeof(Face));
+    h->bvh_nodes_offset = offset; offset = mesh_cache_align(offset + (uint64_t)h->bvh_node_count * sizeof(BvhNode));
+    h->bvh_index_offset = offset; offset = mesh_cache_align(offset + (uint64_t)(h->bvh_node_count > 0 ? h->num_faces : 0) * sizeof(int));
+    h->meshlets_offset = offset; offset = mesh_cache_align(offset + (uint64_t)h->num_meshlets * sizeof(Meshlet));
+    return offset;
+}
+
+static bool mesh_cache_write_section(FILE* f, uint64_t offset, const void* data, uint64_t bytes) {
+    static const char zeros[MESH_CACHE_ALIGN] = { 0 };
+    long long position = ftell(f);
+    if (position < 0 || (uint64_t)position > offset) return false;
+    while ((uint64_t)position < offset) { // Padding up to the aligned section start
+        size_t chunk = (size_t)(offset - (uint64_t)position) < sizeof(zeros) ? (size_t)(offset - (uint64_t)position) : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, f) != chunk) return false;
+        position += (long long)chunk;
+    }
+    return bytes == 0 || fwrite(data, 1, (size_t)bytes, f) == (size_t)bytes;
+}
+
+// Writes the currently loaded model to the sidecar cache. Failures only cost the next open its fast path.
+static void write_mesh_cache(const char* filename, uint64_t source_size, int64_t source_mtime) {
+    if (g_mesh_cache_view.data || num_faces == 0) return;
+    double start_time = al_get_time();
+    char* cache_path = mesh_cache_path(filename);
+    char* temp_path = cache_path ? (char*)malloc(strlen(cache_path) + 5) : NULL;
+    if (!cache_path || !temp_path) { free(cache_path); free(temp_path); return; }
+    sprintf(temp_path, "%s.tmp", cache_path);
+
+    MeshCacheHeader h; memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic));
+    h.version = MESH_CACHE_VERSION; h.layout = mesh_cache_layout();
+    h.source_size = source_size; h.source_mtime = source_mtime;
+    h.flags = mesh_cache_flags() & (quantized_positions.x ? ~0u : ~MESH_CACHE_COMPACT); // Compaction can fall back to floats
+    h.num_vertices = num_vertices; h.num_faces = num_faces; h.bvh_node_count = bvh_nodes ? bvh_node_count : 0; h.num_meshlets = meshlets ? num_meshlets : 0;
+    h.center[0] = g_model_center.x; h.center[1] = g_model_center.y; h.center[2] = g_model_center.z; h.scale = g_model_scale;
+    h.path_length = (uint32_t)strlen(filename);
+    h.file_size = mesh_cache_plan(&h);
+
+    FILE* f = fopen(temp_path, "wb");
+    bool ok = f != NULL;
+    ok = ok && fwrite(&h, sizeof(h), 1, f) == 1;
+    ok = ok && mesh_cache_write_section(f, h.path_offset, filename, (uint64_t)h.path_length + 1);
+    if (quantized_positions.x) {
+        ok = ok && mesh_cache_write_section(f, h.x_offset, quantized_positions.x, (uint64_t)num_vertices * sizeof(int16_t));
+        ok = ok && mesh_cache_write_section(f, h.y_offset, quantized_positions.y, (uint64_t)num_vertices * sizeof(int16_t));
+        ok = ok && mesh_cache_write_section(f, h.z_offset, quantized_positions.z, (uint64_t)num_vertices * sizeof(int16_t));
+    } else {
+        ok = ok && mesh_cache_write_section(f, h.x_offset, original_positions.x, (uint64_t)num_vertices * sizeof(float));
+        ok = ok && mesh_cache_write_section(f, h.y_offset, original_positions.y, (uint64_t)num_vertices * sizeof(float));
+        ok = ok && mesh_cache_write_section(f, h.z_offset, original_positions.z, (uint64_t)num_vertices * sizeof(float));
+    }
+    ok = ok && mesh_cache_write_section(f, h.colors_offset, vertex_colors, (uint64_t)num_vertices * sizeof(*vertex_colors));
+    ok = ok && mesh_cache_write_section(f, h.faces_offset, faces, (uint64_t)num_faces * sizeof(Face));
+    ok = ok && mesh_cache_write_section(f, h.bvh_nodes_offset, bvh_nodes, (uint64_t)h.bvh_node_count * sizeof(BvhNode));
+    ok = ok && mesh_cache_write_section(f, h.bvh_index_offset, bvh_face_index, (uint64_t)(h.bvh_node_count > 0 ? num_faces : 0) * sizeof(int));
+    ok = ok && mesh_cache_write_section(f, h.meshlets_offset, meshlets, (uint64_t)h.num_meshlets * sizeof(Meshlet));
+    ok = ok && mesh_cache_write_section(f, h.file_size, NULL, 0);
+    if (f && fclose(f) != 0) ok = false;
+#ifdef _WIN32
+    if (ok) remove(cache_path); // rename() does not replace existing files on Windows
+#endif
+    if (ok && rename(temp_path, cache_path) != 0) ok = false;
+    if (ok) app_log(true, "INFO", "Wrote mesh cache %s (%.1f MB) in %.3f s.", cache_path, h.file_size / (1024.0 * 1024.0), al_get_time() - start_time);
+    else { app_log(true, "WARN", "Could not write mesh cache %s; the next open will parse the STL again.", cache_path); remove(temp_path); }
+    free(cache_path); free(temp_path);
+}
+
+static bool mesh_cache_section_ok(const MeshCacheHeader* h, uint64_t offset, uint64_t bytes) {
+    return offset % MESH_CACHE_ALIGN == 0 && offset <= h->file_size && bytes <= h->file_size - offset;
+}
+
+// The renderers trust meshlet ranges, so they are checked like the section bounds.
+static bool mesh_cache_meshlets_ok(const MeshCacheHeader* h, const Meshlet* cached) {
+    for (int n = 0; n < h->num_meshlets; ++n) {
+        const Meshlet* ml = &cached[n];
+        if (ml->first_face < 0 || ml->face_count < 0 || ml->face_count > h->num_faces - ml->first_face) return false;
+        if (ml->first_vertex < 0 || ml->vertex_count < 0 || ml->vertex_count > h->num_vertices - ml->first_vertex) return false;
+    }
+    return true;
+}
+
+// bvh_pick() trusts the node table too: children must come after their parent (which also rules out cycles), leaves
+// and face indices must stay inside the model, and no path may be deeper than its fixed traversal stack allows.
+static bool mesh_cache_bvh_ok(const MeshCacheHeader* h, const BvhNode* nodes, const int* face_index) {
+    if (h->bvh_node_count == 0) return true;
+    for (int i = 0; i < h->num_faces; ++i) { if (face_index[i] < 0 || face_index[i] >= h->num_faces) return false; }
+    unsigned char* depth = (unsigned char*)calloc((size_t)h->bvh_node_count, 1); // Deepest path to each node; children only ever follow their parents
+    if (!depth) return false;
+    bool ok = true;
+    for (int n = 0; n < h->bvh_node_count && ok; ++n) {
+        const BvhNode* node = &nodes[n];
+        if (node->count > 0) ok = node->first >= 0 && node->first <= h->num_faces - node->count;
+        else if (node->count < 0 || node->first <= n || node->first >= h->bvh_node_count - 1 || depth[n] >= BVH_MAX_DEPTH) ok = false;
+        else { for (int c = node->first; c <= node->first + 1; ++c) { if (depth[c] <= depth[n]) depth[c] = (unsigned char)(depth[n] + 1); } }
+    }
+    free(depth);
+    return ok;
+}
+
+// Points the model arrays into a valid cache for filename. Returns false (with nothing loaded) if there is no usable cache.
+static bool load_mesh_cache(const char* filename, uint64_t source_size, int64_t source_mtime) {
+    char* cache_path = mesh_cache_path(filename);
+    MappedFile mf;
+    bool mapped = cache_path && map_file_readonly(cache_path, &mf);
+    free(cache_path);
+    if (!mapped) return false;
+    const char* reason = NULL;
+    MeshCacheHeader h;
+    if (mf.size < sizeof(h)) reason = "truncated";
+    else {
+        memcpy(&h, mf.data, sizeof(h));
+        if (memcmp(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic)) != 0) reason = "not a mesh cache";
+        else if (h.version != MESH_CACHE_VERSION || h.layout != mesh_cache_layout()) reason = "old version";
+        else if (h.source_size != source_size || h.source_mtime != source_mtime) reason = "source file changed";
+        else if (h.flags != mesh_cache_flags()) reason = "built with different --weld or --compact settings"; // A float cache would undo --compact
+        else if (h.file_size != mf.size || h.num_vertices <= 0 || h.num_faces <= 0 || h.bvh_node_count < 0 || h.num_meshlets < 0) reason = "corrupt header";
+        else {
+            MeshCacheHeader expected = h;
+            if (mesh_cache_plan(&expected) != h.file_size || memcmp(&expected, &h, sizeof(h)) != 0 ||
+                !mesh_cache_section_ok(&h, h.path_offset, (uint64_t)h.path_length + 1) ||
+                !mesh_cache_section_ok(&h, h.bvh_index_offset, (uint64_t)(h.bvh_node_count > 0 ? h.num_faces : 0) * sizeof(int))) reason = "corrupt layout";
+            else if (h.path_length != strlen(filename) || memcmp(mf.data + h.path_offset, filename, h.path_length) != 0) reason = "different source path";
+            else if (!mesh_cache_meshlets_ok(&h, (const Meshlet*)(mf.data + h.meshlets_offset))) reason = "corrupt meshlets";
+            else if (!mesh_cache_bvh_ok(&h, (const BvhNode*)(mf.data + h.bvh_nodes_offset), (const int*)(mf.data + h.bvh_index_offset))) reason = "corrupt BVH";
+        }
+    }
+    if (reason) { app_log(false, "DEBUG", "Ignoring mesh cache for %s: %s.", filename, reason); unmap_file(&mf); return false; }
+
+    if (!alloc_vertex_positions(&transformed_positions, h.num_vertices)) {
+        app_log(true, "ERROR", "Memory allocation failed for %d transformed vertices.", h.num_vertices); unmap_file(&mf); return false;
+    }
+    unsigned char* base = (unsigned char*)mf.data; // Read-only mapping; nothing writes these arrays after load
+    g_mesh_cache_view = mf;
+    if (h.flags & MESH_CACHE_COMPACT) {
+        quantized_positions.x = (int16_t*)(base + h.x_offset); quantized_positions.y = (int16_t*)(base + h.y_offset); quantized_positions.z = (int16_t*)(base + h.z_offset);
+    } else {
+        original_positions.x = (float*)(base + h.x_offset); original_positions.y = (float*)(base + h.y_offset); original_positions.z = (float*)(base + h.z_offset);
+    }
+    vertex_colors = (uint32_t*)(base + h.colors_offset);
+    faces = (Face*)(base + h.faces_offset);
+    num_vertices = h.num_vertices; num_faces = h.num_faces;
+    bvh_node_count = h.bvh_node_count;
+    bvh_nodes = h.bvh_node_count > 0 ? (BvhNode*)(base + h.bvh_nodes_offset) : NULL;
+    bvh_face_index = h.bvh_node_count > 0 ? (int*)(base + h.bvh_index_offset) : NULL;
+    num_meshlets = h.num_meshlets;
+    meshlets = h.num_meshlets > 0 ? (Meshlet*)(base + h.meshlets_offset) : NULL;
+    build_meshlet_nodes();
+    g_model_center = (Point3D){ h.center[0], h.center[1], h.center[2] }; g_model_scale = h.scale;
+    light_direction = vec_normalize((Point3D) { 0.5f, 0.5f, -1.0f });
+    app_log(true, "INFO", "Loaded cached mesh for %s, Faces: %d, Vertices: %d", filename, num_faces, num_vertices);
+    return true;
+}
+
+// Detects binary vs ASCII from the file header and dispatches to the matching loader, trying the mesh cache first.
+// With a stream, parsed batches are also published to it for the preview, and the load gives up (returning false)
+// once the stream's thread is asked to stop.
+static bool load_stl(const char* filename, StlStream* stream) {
+    uint64_t source_size = 0; int64_t source_mtime = 0;
+    bool use_cache = g_use_mesh_cache && stat_source_file(filename, &source_size, &source_mtime);
+    if (use_cache) {
+        double cache_start = al_get_time();
+        if (load_mesh_cache(filename, source_size, source_mtime)) { app_log(false, "DEBUG", "Mesh cache mapped in %.3f s.", al_get_time() - cache_start); return true; }
+    }
+    MappedFile mf;
+    if (!map_file_readonly(filename, &mf)) {
+        app_log(true, "ERROR", "Could not open STL file '%s'. Check path and permissions.", filename); return false;
+    }
+    StlCodec codec = stl_detect_codec(mf.data, mf.size);
+    bool is_binary = codec == STL_CODEC_NONE && stl_data_is_binary(mf.data, mf.size);
+    if (is_binary) app_log(true, "INFO", "Attempting to load binary STL file: %s", filename);
+    stream_begin(stream, mf.size);
+    double load_start = al_get_time();
+    bool ok = codec != STL_CODEC_NONE ? load_stl_compressed(filename, codec, mf.data, mf.size, stream)
+        : is_binary ? load_stl_binary(filename, mf.data, mf.size, stream) : load_stl_ascii(filename, mf.data, mf.size, stream);
+    unmap_file(&mf);
+    if (!ok && stream_should_stop(stream)) { app_log(true, "INFO", "Loading %s cancelled.", filename); return false; }
+    if (ok) app_log(false, "DEBUG", "%s STL loaded in %.3f s.", codec != STL_CODEC_NONE ? "Compressed" : is_binary ? "Binary" : "ASCII", al_get_time() - load_start);
+    if (ok && use_cache) write_mesh_cache(filename, source_size, source_mtime);
+    return ok;
+}
+static int init_allegro() { /* ... same ... */
+    app_log(false, "DEBUG", "Initializing Allegro...");
+    if (!al_init()) { app_log(true, "ERROR", "Failed to initialize Allegro core!"); return -1; }
+    if (!al_install_keyboard()) { app_log(true, "ERROR", "Failed to initialize the keyboard!"); return -1; }
+    if (!al_install_mouse()) { app_log(true, "ERROR", "Failed to initialize the mouse!"); return -1; }
+    if (!al_init_primitives_addon()) { app_log(true, "ERROR", "Failed to initialize primitives addon!"); return -1; }
+    if (!al_init_font_addon()) { app_log(true, "WARN", "Failed to initialize font addon."); }
+    if (!al_init_ttf_addon()) { app_log(true, "WARN", "Failed to initialize ttf addon."); }
+    app_log(false, "DEBUG", "Allegro initialized successfully.");
+    return 0;
+}
+
+// --- Batched Triangle Submission ---
+#define DRAW_PRIM_BATCH_VERTICES (3 * 65535) // Keeps each al_draw_prim call under common driver primitive limits
+
+// Returns storage for vertex_count triangle-list vertices. Prefers a locked streaming ALLEGRO_VERTEX_BUFFER and
+// falls back to a plain array. Both are sized for the whole mesh being drawn (mesh_faces) and only grow, doubling,
+// so a growing load preview or switching to the drag proxy does not reallocate them every frame. Every successful
+// call must be paired with triangle_batch_submit().
+static ALLEGRO_VERTEX* triangle_batch_begin(int vertex_count, int mesh_faces) {
+    if (vertex_count <= 0) return NULL;
+    int needed = mesh_faces < INT_MAX / 3 ? mesh_faces * 3 : INT_MAX;
+    if (needed < vertex_count) needed = vertex_count;
+    int current = draw_vertex_buffer ? draw_vertex_buffer_capacity : draw_vertex_capacity;
+    int wanted_capacity = current >= needed ? current : current > INT_MAX / 2 || current * 2 < needed ? needed : current * 2;
+
+    if (!draw_vertex_buffer_unsupported) {
+        if (draw_vertex_buffer && draw_vertex_buffer_capacity < wanted_capacity) { al_destroy_vertex_buffer(draw_vertex_buffer); draw_vertex_buffer = NULL; }
+        if (!draw_vertex_buffer) {
+            draw_vertex_buffer = al_create_vertex_buffer(NULL, NULL, wanted_capacity, ALLEGRO_PRIM_BUFFER_STREAM);
+            if (draw_vertex_buffer) { draw_vertex_buffer_capacity = wanted_capacity; app_log(false, "DEBUG", "Created vertex buffer for %d vertices.", wanted_capacity); }
+            else { draw_vertex_buffer_unsupported = true; app_log(false, "DEBUG", "Vertex buffers unavailable. Using al_draw_prim batches."); }
+        }
+        if (draw_vertex_buffer) {
+            ALLEGRO_VERTEX* locked = (ALLEGRO_VERTEX*)al_lock_vertex_buffer(draw_vertex_buffer, 0, vertex_count, ALLEGRO_LOCK_WRITEONLY);
+            if (locked) { draw_vertex_buffer_locked = true; return locked; }
+            app_log(true, "WARN", "Failed to lock vertex buffer. Falling back to al_draw_prim batches.");
+            al_destroy_vertex_buffer(draw_vertex_buffer); draw_vertex_buffer = NULL; draw_vertex_buffer_unsupported = true;
+        }
+    }
+
+    if (draw_vertex_capacity < wanted_capacity) {
+        ALLEGRO_VERTEX* resized = (ALLEGRO_VERTEX*)realloc(draw_vertices, (size_t)wanted_capacity * sizeof(ALLEGRO_VERTEX));
+        if (!resized) { app_log(true, "ERROR", "Failed to allocate draw buffer for %d vertices.", wanted_capacity); return NULL; }
+        draw_vertices = resized; draw_vertex_capacity = wanted_capacity;
+    }
+    return draw_vertices;
+}
+
+static void triangle_batch_submit(int vertex_count) {
+    if (draw_vertex_buffer_locked) {
+        al_unlock_vertex_buffer(draw_vertex_buffer); draw_vertex_buffer_locked = false;
+        al_draw_vertex_buffer(draw_vertex_buffer, NULL, 0, vertex_count, ALLEGRO_PRIM_TRIANGLE_LIST);
+        return;
+    }
+    for (int start = 0; start < vertex_count; start += DRAW_PRIM_BATCH_VERTICES) {
+        int end = start + DRAW_PRIM_BATCH_VERTICES < vertex_count ? start + DRAW_PRIM_BATCH_VERTICES : vertex_count;
+        al_draw_prim(draw_vertices, NULL, NULL, start, end, ALLEGRO_PRIM_TRIANGLE_LIST);
+    }
+}
+
+// Draws vertex_count / 2 lines; batches stay even so no line is split between two calls.
+static void draw_line_list(const ALLEGRO_VERTEX* vertices, int vertex_count) {
+    const int batch = DRAW_PRIM_BATCH_VERTICES - DRAW_PRIM_BATCH_VERTICES % 2;
+    for (int start = 0; start < vertex_count; start += batch) {
+        int end = start + batch < vertex_count ? start + batch : vertex_count;
+        al_draw_prim(vertices, NULL, NULL, start, end, ALLEGRO_PRIM_LINE_LIST);
+    }
+}
+
+// --- Depth Sorting ---
+// Maps a float to a uint32 whose unsigned order matches the float order (negatives flip all bits,
+// positives flip the sign bit). Inverting the result sorts back to front, which is what painter's order needs.
+static uint32_t depth_sort_key(float depth) {
+    uint32_t bits; memcpy(&bits, &depth, sizeof(bits));
+    uint32_t ascending = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    return ~ascending;
+}
+
+static bool ensure_depth_key_capacity(int count) {
+    if (count <= depth_key_capacity) return true;
+    DepthKey* keys = (DepthKey*)realloc(depth_keys, (size_t)count * sizeof(DepthKey));
+    if (keys) depth_keys = keys;
+    DepthKey* scratch = (DepthKey*)realloc(depth_keys_scratch, (size_t)count * sizeof(DepthKey));
+    if (scratch) depth_keys_scratch = scratch;
+    if (!keys || !scratch) { app_log(true, "ERROR", "Failed to allocate depth sort buffers for %d faces.", count); return false; }
+    depth_key_capacity = count;
+    return true;
+}
+
+// Stable LSD radix sort on 8-bit digits. All four histograms are built in one read, and passes where every
+// key shares the same digit are skipped. The sorted result always ends up back in depth_keys.
+static void radix_sort_depth_keys(int count) {
+    if (count <= 1) return;
+    uint32_t histograms[4][256]; memset(histograms, 0, sizeof(histograms));
+    for (int i = 0; i < count; ++i) {
+        uint32_t key = depth_keys[i].key;
+        histograms[0][key & 0xFF]++; histograms[1][(key >> 8) & 0xFF]++;
+        histograms[2][(key >> 16) & 0xFF]++; histograms[3][key >> 24]++;
+    }
+    DepthKey* src = depth_keys; DepthKey* dst = depth_keys_scratch;
+    for (int pass = 0; pass < 4; ++pass) {
+        uint32_t* histogram = histograms[pass]; int shift = pass * 8;
+        if (histogram[(src[0].key >> shift) & 0xFF] == (uint32_t)count) continue; // Digit is identical for all keys
+        uint32_t offset = 0;
+        for (int d = 0; d < 256; ++d) { uint32_t c = histogram[d]; histogram[d] = offset; offset += c; }
+        for (int i = 0; i < count; ++i) dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+        DepthKey* tmp = src; src = dst; dst = tmp;
+    }
+    if (src != depth_keys) memcpy(depth_keys, src, (size_t)count * sizeof(DepthKey));
+}
+
+// --- Level of Detail ---
+// Sorting and drawing a multi-million-triangle scan cannot keep up with 60 FPS while dragging. After a load, a background
+// thread builds a proxy of at most LOD_DRAG_FACE_BUDGET faces by vertex clustering with quadric error placement:
+// vertices are bucketed into a uniform grid, each occupied cell gathers the area-weighted plane quadrics of the faces
+// touching it, and its single output vertex goes where that summed error is smallest. Faces that end up with fewer
+// than three distinct cells disappear. The render loop draws the proxy while rotating or panning and the full mesh
+// otherwise.
+#define LOD_DRAG_FACE_BUDGET 150000
+#define LOD_MAX_GRID_ATTEMPTS 8
+#define LOD_STOP_CHECK_MASK 0xFFFF // Poll al_get_thread_should_stop() every 64K items
+
+typedef struct {
+    double q[10];  // Symmetric 4x4 plane quadric, upper triangle: aa ab ac ad bb bc bd cc cd dd
+    double sum[3]; // Position sum for the mean, used to regularize the placement
+    float color[4]; // Channel sums on the 0-255 scale
+    int count;
+    int out_index; // Vertex index in the proxy, or -1 while no surviving face uses this cell
+} LodCluster;
+
+typedef struct {
+    ALLEGRO_THREAD* thread;
+    ALLEGRO_MUTEX* mutex;
+    bool ready;        // Guarded by mutex; mesh is complete and owned by this state once set
+    RenderMesh mesh;
+    RenderMesh source; // Full mesh the builder reads; stays untouched until lod_release() joined the thread
+} LodState;
+
+LodState g_lod;
+
+static void free_render_mesh(RenderMesh* mesh) {
+    free_vertex_positions(&mesh->original); free_vertex_positions(&mesh->transformed);
+    free(mesh->colors); free(mesh->faces);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+static bool lod_should_stop(ALLEGRO_THREAD* thread, int i) { return (i & LOD_STOP_CHECK_MASK) == 0 && al_get_thread_should_stop(thread); }
+
+static int lod_cell_coord(float v, float inv_cell, int grid) { return clamp_int((int)((v + MODEL_VIEW_SIZE * 0.5f) * inv_cell), 0, grid - 1); }
+
+// Maps every vertex to its grid cell's cluster. cells holds 3 coordinates per cluster. Returns the cluster count, or -1
+// if the thread was asked to stop or the table could not grow.
+static int lod_assign_clusters(ALLEGRO_THREAD* thread, const RenderMesh* src, int grid, int* vertex_cluster, int32_t* cells) {
+    size_t table_size = 1 << 16; int cluster_count = 0;
+    int* table = (int*)malloc(table_size * sizeof(int));
+    if (!table) return -1;
+    memset(table, 0xFF, table_size * sizeof(int));
+    const float inv_cell = (float)grid / MODEL_VIEW_SIZE;
+    for (int i = 0; i < src->num_vertices; ++i) {
+        if (lod_should_stop(thread, i)) { free(table); return -1; }
+        if ((size_t)cluster_count * 2 >= table_size) { // Keep the load factor under 1/2
+            size_t grown_size = table_size * 2;
+            int* grown = (int*)malloc(grown_size * sizeof(int));
+            if (!grown) { free(table); return -1; }
+            memset(grown, 0xFF, grown_size * sizeof(int));
+            for (int c = 0; c < cluster_count; ++c) {
+                size_t slot = weld_hash(cells[c * 3], cells[c * 3 + 1], cells[c * 3 + 2]) & (grown_size - 1);
+                while (grown[slot] >= 0) slot = (slot + 1) & (grown_size - 1);
+                grown[slot] = c;
+            }
+            free(table); table = grown; table_size = grown_size;
+        }
+        Point3D p = render_mesh_vertex(src, i);
+        int32_t cx = lod_cell_coord(p.x, inv_cell, grid);
+        int32_t cy = lod_cell_coord(p.y, inv_cell, grid);
+        int32_t cz = lod_cell_coord(p.z, inv_cell, grid);
+        size_t slot = weld_hash(cx, cy, cz) & (table_size - 1);
+        while (table[slot] >= 0) {
+            const int32_t* k = &cells[table[slot] * 3];
+            if (k[0] == cx && k[1] == cy && k[2] == cz) break;
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] < 0) {
+            table[slot] = cluster_count;
+            cells[cluster_count * 3] = cx; cells[cluster_count * 3 + 1] = cy; cells[cluster_count * 3 + 2] = cz;
+            cluster_count++;
+        }
+        vertex_cluster[i] = table[slot];
+    }
+    free(table);
+    return cluster_count;
+}
+
+static bool lod_face_clusters(const RenderMesh* src, const int* vertex_cluster, int f, int c[3]) {
+    for (int k = 0; k < 3; ++k) {
+        int vi = src->faces[f].v_idx[k];
+        if (vi < 0 || vi >= src->num_vertices) return false;
+        c[k] = vertex_cluster[vi];
+    }
+    return c[0] != c[1] && c[1] != c[2] && c[0] != c[2];
+}
+
+// Minimizes the cluster's quadric error, pulled slightly toward the mean so flat or edge-only clusters (singular
+// quadrics) stay well defined, then keeps the result within half a cell of the cell it came from.
+static Point3D lod_place_vertex(const LodCluster* c, const int32_t* cell, float cell_size) {
+    double mean[3] = { c->sum[0] / c->count, c->sum[1] / c->count, c->sum[2] / c->count };
+    const double* q = c->q;
+    double lambda = 1e-3 * (q[0] + q[4] + q[7]) + 1e-12;
+    double a[3][3] = { { q[0] + lambda, q[1], q[2] }, { q[1], q[4] + lambda, q[5] }, { q[2], q[5], q[7] + lambda } };
+    double b[3] = { -q[3] + lambda * mean[0], -q[6] + lambda * mean[1], -q[8] + lambda * mean[2] };
+    double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    double x[3] = { mean[0], mean[1], mean[2] };
+    if (fabs(det) > 1e-30) {
+        for (int col = 0; col < 3; ++col) { // Cramer's rule
+            double m[3][3]; memcpy(m, a, sizeof(m));
+            for (int row = 0; row < 3; ++row) m[row][col] = b[row];
+            x[col] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) / det;
+        }
+    }
+    Point3D p;
+    float* out[3] = { &p.x, &p.y, &p.z };
+    for (int k = 0; k < 3; ++k) {
+        double lo = -MODEL_VIEW_SIZE * 0.5 + (cell[k] - 0.5) * cell_size, hi = lo + 2.0 * cell_size;
+        *out[k] = (float)(isfinite(x[k]) ? fmin(hi, fmax(lo, x[k])) : mean[k]);
+    }
+    return p;
+}
+
+// Does the work of lod_build_proxy(). *clusters_out receives the cluster array so the caller can free it.
+static bool lod_build_proxy_with(ALLEGRO_THREAD* thread, const RenderMesh* src, int face_budget, int* vertex_cluster, int32_t* cells,
+    LodCluster** clusters_out, RenderMesh* out) {
+
+    // Surviving faces scale with the square of the grid resolution; shrink until the budget fits
+    int grid = (int)sqrt(face_budget / 2.0), cluster_count = 0, surviving = 0;
+    for (int attempt = 0; attempt < LOD_MAX_GRID_ATTEMPTS; ++attempt) {
+        cluster_count = lod_assign_clusters(thread, src, grid, vertex_cluster, cells);
+        if (cluster_count < 0) return false;
+        surviving = 0;
+        for (int f = 0; f < src->num_faces; ++f) {
+            int c[3];
+            if (lod_should_stop(thread, f)) return false;
+            if (lod_face_clusters(src, vertex_cluster, f, c)) surviving++;
+        }
+        if (surviving <= face_budget || grid <= 2) break;
+        grid = (int)fmax(2.0, grid * sqrt((double)face_budget / surviving) * 0.97);
+    }
+    if (surviving > face_budget) app_log(true, "WARN", "Drag proxy still has %d faces after %d attempts.", surviving, LOD_MAX_GRID_ATTEMPTS);
+
+    LodCluster* clusters = *clusters_out = (LodCluster*)calloc((size_t)cluster_count, sizeof(LodCluster));
+    out->faces = (Face*)malloc((size_t)(surviving > 0 ? surviving : 1) * sizeof(Face));
+    if (!clusters || !out->faces) return false;
+    for (int i = 0; i < src->num_vertices; ++i) {
+        LodCluster* c = &clusters[vertex_cluster[i]];
+        Point3D p = render_mesh_vertex(src, i);
+        c->sum[0] += p.x; c->sum[1] += p.y; c->sum[2] += p.z;
+        uint32_t color = src->colors[i];
+        c->color[0] += RGBA8_R(color); c->color[1] += RGBA8_G(color); c->color[2] += RGBA8_B(color); c->color[3] += RGBA8_A(color);
+        c->count++;
+    }
+    for (int f = 0; f < src->num_faces; ++f) {
+        if (lod_should_stop(thread, f)) return false;
+        int c[3];
+        bool survives = lod_face_clusters(src, vertex_cluster, f, c);
+        const int* v = src->faces[f].v_idx;
+        if (v[0] < 0 || v[1] < 0 || v[2] < 0 || v[0] >= src->num_vertices || v[1] >= src->num_vertices || v[2] >= src->num_vertices) continue;
+        Point3D p0 = render_mesh_vertex(src, v[0]), p1 = render_mesh_vertex(src, v[1]), p2 = render_mesh_vertex(src, v[2]);
+        Point3D n = vec_cross_product(vec_subtract(p1, p0), vec_subtract(p2, p0));
+        double len = sqrt((double)n.x * n.x + (double)n.y * n.y + (double)n.z * n.z);
+        if (len > 0.0) { // Area-weighted plane quadric, added to the cluster of every corner
+            double pa = n.x / len, pb = n.y / len, pc = n.z / len, pd = -(pa * p0.x + pb * p0.y + pc * p0.z), w = 0.5 * len;
+            double plane_q[10] = { pa * pa, pa * pb, pa * pc, pa * pd, pb * pb, pb * pc, pb * pd, pc * pc, pc * pd, pd * pd };
+            for (int k = 0; k < 3; ++k) {
+                LodCluster* cl = &clusters[vertex_cluster[v[k]]];
+                for (int j = 0; j < 10; ++j) cl->q[j] += w * plane_q[j];
+            }
+        }
+        if (!survives) continue;
+        Face* out_face = &out->faces[out->num_faces++];
+        for (int k = 0; k < 3; ++k) out_face->v_idx[k] = c[k]; // Cluster ids for now, compacted below
+    }
+
+    // Compact to the clusters that surviving faces reference
+    for (int c = 0; c < cluster_count; ++c) clusters[c].out_index = -1;
+    for (int f = 0; f < out->num_faces; ++f)
+        for (int k = 0; k < 3; ++k) {
+            LodCluster* cl = &clusters[out->faces[f].v_idx[k]];
+            if (cl->out_index < 0) cl->out_index = out->num_vertices++;
+            out->faces[f].v_idx[k] = cl->out_index;
+        }
+    if (!alloc_vertex_positions(&out->original, out->num_vertices) || !alloc_vertex_positions(&out->transformed, out->num_vertices) ||
+        !(out->colors = (uint32_t*)malloc((size_t)(out->num_vertices > 0 ? out->num_vertices : 1) * sizeof(uint32_t)))) {
+        return false;
+    }
+    const float cell_size = MODEL_VIEW_SIZE / grid;
+    for (int c = 0; c < cluster_count; ++c) {
+        const LodCluster* cl = &clusters[c];
+        if (cl->out_index < 0) continue;
+        Point3D p = lod_place_vertex(cl, &cells[c * 3], cell_size);
+        out->original.x[cl->out_index] = p.x; out->original.y[cl->out_index] = p.y; out->original.z[cl->out_index] = p.z;
+        float inv_count = 1.0f / cl->count;
+        out->colors[cl->out_index] = pack_rgba8((int)(cl->color[0] * inv_count + 0.5f), (int)(cl->color[1] * inv_count + 0.5f),
+            (int)(cl->color[2] * inv_count + 0.5f), (int)(cl->color[3] * inv_count + 0.5f));
+    }
+    compute_face_normals(&out->original, out->faces, out->num_faces, out->num_vertices);
+    return true;
+}
+
+// Builds the proxy for src into out. Returns false when cancelled or out of memory.
+static bool lod_build_proxy(ALLEGRO_THREAD* thread, const RenderMesh* src, int face_budget, RenderMesh* out) {
+    memset(out, 0, sizeof(*out));
+    int* vertex_cluster = (int*)malloc((size_t)src->num_vertices * sizeof(int));
+    int32_t* cells = (int32_t*)malloc((size_t)src->num_vertices * 3 * sizeof(int32_t));
+    LodCluster* clusters = NULL;
+    bool ok = vertex_cluster && cells && lod_build_proxy_with(thread, src, face_budget, vertex_cluster, cells, &clusters, out);
+    if (!ok && !al_get_thread_should_stop(thread)) app_log(true, "WARN", "Not enough memory to build the drag proxy; dragging uses the full mesh.");
+    free(vertex_cluster); free(cells); free(clusters);
+    if (!ok) free_render_mesh(out);
+    return ok;
+}
+
+static void* lod_build_thread_proc(ALLEGRO_THREAD* thread, void* arg) {
+    (void)arg;
+    double start_time = al_get_time();
+    RenderMesh proxy;
+    if (lod_build_proxy(thread, &g_lod.source, LOD_DRAG_FACE_BUDGET, &proxy)) {
+        al_lock_mutex(g_lod.mutex);
+        g_lod.mesh = proxy; g_lod.ready = true;
+        al_unlock_mutex(g_lod.mutex);
+        app_log(true, "INFO", "Drag proxy ready: %d faces, %d vertices (full mesh %d faces) in %.3f s.",
+            proxy.num_faces, proxy.num_vertices, g_lod.source.num_faces, al_get_time() - start_time);
+    }
+    return NULL;
+}
+
+// Starts building the drag proxy for the currently loaded model. Call lod_release() before the model data changes.
+static void lod_start_build(void) {
+    if (num_faces <= LOD_DRAG_FACE_BUDGET) { app_log(false, "DEBUG", "Model has %d faces; no drag proxy needed.", num_faces); return; }
+    if (!g_lod.mutex) g_lod.mutex = al_create_mutex();
+    if (!g_lod.mutex) { app_log(true, "WARN", "Failed to create the LOD mutex; dragging uses the full mesh."); return; }
+    g_lod.source = full_render_mesh(); g_lod.ready = false;
+    g_lod.thread = al_create_thread(lod_build_thread_proc, NULL);
+    if (!g_lod.thread) { app_log(true, "WARN", "Failed to start the LOD thread; dragging uses the full mesh."); return; }
+    al_start_thread(g_lod.thread);
+}
+
+// Stops a build in progress and frees the proxy.
+static void lod_release(void) {
+    if (g_lod.thread) { al_set_thread_should_stop(g_lod.thread); al_join_thread(g_lod.thread, NULL); al_destroy_thread(g_lod.thread); }
+    if (g_lod.ready) free_render_mesh(&g_lod.mesh);
+    if (g_lod.mutex) al_destroy_mutex(g_lod.mutex);
+    memset(&g_lod, 0, sizeof(g_lod));
+}
+
+// Copies the proxy into out if it has been built.
+static bool lod_drag_mesh(RenderMesh* out) {
+    if (!g_lod.mutex) return false;
+    al_lock_mutex(g_lod.mutex);
+    bool ready = g_lod.ready;
+    if (ready) *out = g_lod.mesh;
+    al_unlock_mutex(g_lod.mutex);
+    return ready;
+}
+
+// --- Background Loading ---
+// The render loop side of the streaming load: stream_poll() is called every timer tick, pulls the batches published
+// so far into g_stream.preview and reports when the loading thread has finished. The preview is normalized the same
+// way finalize_model_data() will normalize the full model, but from the bounds seen so far; it is re-fitted whenever
+// those drift by more than STREAM_REFIT_TOLERANCE, so it settles as the file streams in.
+#define STREAM_REFIT_TOLERANCE 0.05f // Fraction of the view size the preview may be off-center or mis-scaled
+#define LOAD_BAR_HEIGHT 18
+
+typedef enum { STREAM_LOADING, STREAM_LOADED, STREAM_FAILED, STREAM_CANCELLED } StreamStatus;
+
+static void* stream_thread_proc(ALLEGRO_THREAD* thread, void* arg) {
+    (void)thread; StlStream* s = (StlStream*)arg;
+    bool ok = load_stl(s->filename, s);
+    al_lock_mutex(s->mutex); s->done = true; s->ok = ok; al_unlock_mutex(s->mutex);
+    return NULL;
+}
+
+static bool stream_loading(void) { return g_stream.thread != NULL; }
+
+static void stream_free_batches(StreamBatch* batch) {
+    while (batch) { StreamBatch* next = batch->next; free(batch->vertices); free(batch); batch = next; }
+}
+
+// Joins the loading thread, asking it to stop first, and frees everything the stream owns. Whatever the thread
+// managed to load stays in the model globals.
+static void stream_release(void) {
+    StlStream* s = &g_stream;
+    if (s->thread) { al_set_thread_should_stop(s->thread); al_join_thread(s->thread, NULL); al_destroy_thread(s->thread); }
+    stream_free_batches(s->head);
+    free_render_mesh(&s->preview);
+    if (s->mutex) al_destroy_mutex(s->mutex);
+    free(s->filename);
+    memset(s, 0, sizeof(*s));
+}
+
+// Starts loading filename in the background. The model globals must be empty. Falls back to a blocking load if the
+// thread cannot be started; returns false only when that fails.
+static bool stream_start(const char* filename) {
+    StlStream* s = &g_stream;
+    memset(s, 0, sizeof(*s));
+    s->mutex = al_create_mutex();
+    s->filename = s->mutex ? (char*)malloc(strlen(filename) + 1) : NULL;
+    if (s->filename) { strcpy(s->filename, filename); s->thread = al_create_thread(stream_thread_proc, s); }
+    if (!s->thread) {
+        app_log(true, "WARN", "Failed to start the loading thread; loading %s in the foreground.", filename);
+        stream_release();
+        if (!load_stl(filename, NULL)) return false;
+        lod_start_build();
+        return true;
+    }
+    s->min_coord = (Point3D){ FLT_MAX, FLT_MAX, FLT_MAX }; s->max_coord = (Point3D){ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    s->scale = 0.0f; // Nothing fitted yet
+    s->start_time = al_get_time();
+    al_start_thread(s->thread);
+    return true;
+}
+
+// Asks the loading thread to give up; stream_poll() reports STREAM_CANCELLED once it has.
+static void stream_cancel(void) {
+    if (!g_stream.thread || g_stream.cancelled) return;
+    app_log(true, "INFO", "Cancelling load of %s.", g_stream.filename);
+    g_stream.cancelled = true;
+    al_set_thread_should_stop(g_stream.thread);
+}
+
+static void stream_fit(const StlStream* s, Point3D* center, float* scale) {
+    center->x = (s->min_coord.x + s->max_coord.x) / 2.0f;
+    center->y = (s->min_coord.y + s->max_coord.y) / 2.0f;
+    center->z = (s->min_coord.z + s->max_coord.z) / 2.0f;
+    float max_extent = max_float(s->max_coord.x - s->min_coord.x, max_float(s->max_coord.y - s->min_coord.y, s->max_coord.z - s->min_coord.z));
+    *scale = max_extent > 1e-6f ? MODEL_VIEW_SIZE / max_extent : 1.0f;
+}
+
+// Gives preview vertices from first_vertex on the Y gradient of the current fit.
+static void stream_color_preview(StlStream* s, int first_vertex) {
+    float min_y = (s->min_coord.y - s->center.y) * s->scale, max_y = (s->max_coord.y - s->center.y) * s->scale;
+    uint32_t color_bottom = pack_rgba8(0, 0, 255, 255); uint32_t color_top = pack_rgba8(0, 255, 0, 255);
+    for (int i = first_vertex; i < s->preview.num_vertices; ++i) {
+        float t = (max_y - min_y) > 1e-6f ? (s->preview.original.y[i] - min_y) / (max_y - min_y) : 0.5f;
+        s->preview.colors[i] = color_lerp(color_bottom, color_top, min_float(1.0f, max_float(0.0f, t)));
+    }
+}
+
+// Moves the preview from the fit it was built with to the one for the current bounds.
+static void stream_refit_preview(StlStream* s, Point3D center, float scale) {
+    float* px = s->preview.original.x; float* py = s->preview.original.y; float* pz = s->preview.original.z;
+    float back = 1.0f / s->scale;
+    for (int i = 0; i < s->preview.num_vertices; ++i) {
+        px[i] = (px[i] * back + s->center.x - center.x) * scale;
+        py[i] = (py[i] * back + s->center.y - center.y) * scale;
+        pz[i] = (pz[i] * back + s->center.z - center.z) * scale;
+    }
+    s->center = center; s->scale = scale;
+    stream_color_preview(s, 0); // The Y range changed along with the fit
+}
+
+static bool stream_reserve_preview(StlStream* s, int face_count) {
+    RenderMesh* p = &s->preview;
+    if (face_count <= s->preview_capacity) return true;
+    int capacity = s->preview_capacity > 0 ? s->preview_capacity : STREAM_FIRST_BATCH_FACES;
+    while (capacity < face_count) capacity = capacity > INT_MAX / 6 ? face_count : capacity * 2;
+    if (capacity > INT_MAX / 3) return false;
+    int vertex_capacity = s->preview_capacity * 3;
+    if (!grow_vertex_positions(&p->original, p->num_vertices, &vertex_capacity, capacity * 3)) return false;
+    VertexPositions transformed; // Rewritten every frame, so nothing to keep
+    if (!alloc_vertex_positions(&transformed, capacity * 3)) return false;
+    free_vertex_positions(&p->transformed); p->transformed = transformed;
+    uint32_t* colors = (uint32_t*)realloc(p->colors, (size_t)capacity * 3 * sizeof(uint32_t));
+    if (colors) p->colors = colors;
+    Face* grown_faces = (Face*)realloc(p->faces, (size_t)capacity * sizeof(Face));
+    if (grown_faces) p->faces = grown_faces;
+    if (!colors || !grown_faces) return false;
+    s->preview_capacity = capacity;
+    return true;
+}
+
+// Appends a batch to the preview using the current fit.
+static bool stream_append_batch(StlStream* s, const StreamBatch* batch) {
+    RenderMesh* p = &s->preview;
+    if (batch->face_count > INT_MAX / 3 - p->num_faces || !stream_reserve_preview(s, p->num_faces + batch->face_count)) return false;
+    int first_face = p->num_faces, first_vertex = p->num_vertices;
+    for (int i = 0; i < batch->face_count * 3; ++i) {
+        Point3D v = batch->vertices[i];
+        p->original.x[first_vertex + i] = (v.x - s->center.x) * s->scale;
+        p->original.y[first_vertex + i] = (v.y - s->center.y) * s->scale;
+        p->original.z[first_vertex + i] = (v.z - s->center.z) * s->scale;
+    }
+    for (int f = 0; f < batch->face_count; ++f) {
+        int vi = first_vertex + f * 3;
+        p->faces[first_face + f].v_idx[0] = vi; p->faces[first_face + f].v_idx[1] = vi + 1; p->faces[first_face + f].v_idx[2] = vi + 2;
+    }
+    p->num_faces += batch->face_count; p->num_vertices += batch->face_count * 3;
+    compute_face_normals(&p->original, p->faces + first_face, batch->face_count, p->num_vertices);
+    stream_color_preview(s, first_vertex);
+    return true;
+}
+
+// Takes everything the loading thread has published since the last call. Sets *changed when the preview gained faces.
+// Once the thread is done it is joined and the preview freed; on STREAM_LOADED the model globals are ready to draw.
+static StreamStatus stream_poll(bool* changed) {
+    StlStream* s = &g_stream;
+    *changed = false;
+    if (!s->thread) return STREAM_LOADED;
+    al_lock_mutex(s->mutex);
+    StreamBatch* batches = s->head; s->head = s->tail = NULL;
+    s->progress = s->bytes_total > 0 ? (float)((double)s->bytes_done / (double)s->bytes_total) : 0.0f;
+    s->shown_finishing = s->finishing;
+    bool done = s->done, ok = s->ok;
+    al_unlock_mutex(s->mutex);
+
+    if (done) {
+        stream_free_batches(batches); // The full model replaces the preview
+        double elapsed = al_get_time() - s->start_time;
+        bool cancelled = s->cancelled;
+        stream_release();
+        if (!ok) { free_render_buffers(); return cancelled ? STREAM_CANCELLED : STREAM_FAILED; } // The thread only freed the model arrays
+        app_log(false, "DEBUG", "Background load finished after %.3f s.", elapsed);
+        lod_start_build();
+        return STREAM_LOADED;
+    }
+    if (!batches) return STREAM_LOADING;
+
+    bool first_faces = s->preview.num_faces == 0;
+    for (StreamBatch* b = batches; b; b = b->next) {
+        for (int i = 0; i < b->face_count * 3; ++i) {
+            Point3D v = b->vertices[i];
+            s->min_coord.x = min_float(s->min_coord.x, v.x); s->max_coord.x = max_float(s->max_coord.x, v.x);
+            s->min_coord.y = min_float(s->min_coord.y, v.y); s->max_coord.y = max_float(s->max_coord.y, v.y);
+            s->min_coord.z = min_float(s->min_coord.z, v.z); s->max_coord.z = max_float(s->max_coord.z, v.z);
+        }
+    }
+    Point3D center; float scale;
+    stream_fit(s, &center, &scale);
+    if (s->scale == 0.0f) { s->center = center; s->scale = scale; }
+    else {
+        float drift = vec_magnitude(vec_subtract(center, s->center)) * scale / MODEL_VIEW_SIZE;
+        if (drift > STREAM_REFIT_TOLERANCE || fabsf(scale / s->scale - 1.0f) > STREAM_REFIT_TOLERANCE) stream_refit_preview(s, center, scale);
+    }
+    bool appended = true;
+    for (StreamBatch* b = batches; b && appended; b = b->next) appended = stream_append_batch(s, b);
+    if (!appended) app_log(false, "WARN", "Out of memory for the load preview; showing %d faces until loading finishes.", s->preview.num_faces);
+    stream_free_batches(batches);
+    *changed = true;
+    if (first_faces && s->preview.num_faces > 0)
+        app_log(true, "INFO", "First %d faces on screen %.3f s after the load started.", s->preview.num_faces, al_get_time() - s->start_time);
+    return STREAM_LOADING;
+}
+
+// Progress bar along the bottom of the window while a load is running.
+static void draw_load_progress(ALLEGRO_FONT* font) {
+    const StlStream* s = &g_stream;
+    float fraction = min_float(1.0f, max_float(0.0f, s->progress));
+    float top = SCREEN_H - 10.0f - LOAD_BAR_HEIGHT, right = SCREEN_W - 10.0f;
+    al_draw_filled_rectangle(10.0f, top, right, top + LOAD_BAR_HEIGHT, al_map_rgb(50, 50, 50));
+    al_draw_filled_rectangle(10.0f, top, 10.0f + (right - 10.0f) * fraction, top + LOAD_BAR_HEIGHT, al_map_rgb(60, 140, 220));
+    al_draw_rectangle(10.0f, top, right, top + LOAD_BAR_HEIGHT, al_map_rgb(200, 200, 200), 1.0f);
+    if (!font) return;
+    char text[128];
+    if (s->cancelled) snprintf(text, sizeof(text), "Cancelling...");
+    else if (s->shown_finishing) snprintf(text, sizeof(text), "Preparing %d faces (normals, picking)...", s->preview.num_faces);
+    else snprintf(text, sizeof(text), "Loading %.0f%% - %d faces so far. C cancel.", fraction * 100.0f, s->preview.num_faces);
+    al_draw_text(font, al_map_rgb(255, 255, 255), SCREEN_W / 2.0f, top - 22.0f, ALLEGRO_ALIGN_CENTER, text);
+}
+
+// --- Face Shading and Culling ---
+// Rotating a face normal n by M and dotting it with a view-space vector v equals dot(n, M^T v), so per frame the
+// light direction and the view axis are moved into object space once and every face costs two dot products. In
+// perspective the view direction differs per face, so culling uses the winding of the projected corners instead:
+// it has the sign of dot(p0 - eye, n), which is the same test.
+typedef struct {
+    Point3D light;       // light_direction in object space
+    Point3D view_z;      // Object-space direction that ends up as +z (away from the viewer) after rotation
+    bool screen_winding; // Cull by projected winding (perspective) instead of view_z
+} FaceShading;
+
+static FaceShading face_shading_for_view(const ViewTransform* view) {
+    const float (*m)[3] = view->rotation;
+    FaceShading shading;
+    shading.light.x = m[0][0] * light_direction.x + m[1][0] * light_direction.y + m[2][0] * light_direction.z;
+    shading.light.y = m[0][1] * light_direction.x + m[1][1] * light_direction.y + m[2][1] * light_direction.z;
+    shading.light.z = m[0][2] * light_direction.x + m[1][2] * light_direction.y + m[2][2] * light_direction.z;
+    shading.view_z = (Point3D){ m[2][0], m[2][1], m[2][2] };
+    shading.screen_winding = view->perspective;
+    return shading;
+}
+
+// True when the face points away from the viewer and culling is enabled. tx/ty are the projected positions; only
+// read in perspective.
+static bool face_is_culled(const FaceShading* shading, const Face* face, const float* tx, const float* ty) {
+    if (!g_backface_culling) return false;
+    if (!shading->screen_winding) return vec_dot_product(face->normal, shading->view_z) > 0.0f;
+    int i0 = face->v_idx[0], i1 = face->v_idx[1], i2 = face->v_idx[2];
+    return (tx[i1] - tx[i0]) * (ty[i2] - ty[i0]) - (tx[i2] - tx[i0]) * (ty[i1] - ty[i0]) > 0.0f;
+}
+
+static float face_light_intensity(const FaceShading* shading, Point3D normal) {
+    float light = ambient_light_intensity + diffuse_light_intensity * fmaxf(0.0f, vec_dot_product(normal, shading->light));
+    return fminf(1.0f, fmaxf(0.0f, light));
+}
+
+// --- Frame Profiler ---
+// Wall-clock time of each render stage, measured with al_get_time() (a monotonic high-resolution clock). Stages are
+// accumulated per presented frame. Frames that actually re-rendered the model enter a rolling window shown by the
+// T overlay, and with --profile-csv=<file> every presented frame is also written out as one CSV row. In Z-buffer mode
+// "shade_depth" is face setup, "sort" is tile binning and "draw" is rasterizing plus the bitmap upload.
+#define PROFILE_WINDOW 240 // Rendered frames in the rolling statistics
+#define PROFILE_CSV_BUFFER (64 * 1024)
+
+typedef enum { PROFILE_TRANSFORM, PROFILE_SHADE, PROFILE_SORT, PROFILE_DRAW, PROFILE_FLIP, PROFILE_FRAME, PROFILE_STAGE_COUNT } ProfileStage;
+static const char* const k_profile_stage_names[PROFILE_STAGE_COUNT] = { "transform", "shade_depth", "sort", "draw", "flip", "frame" };
+
+typedef struct {
+    double frame_start;
+    double current[PROFILE_STAGE_COUNT];                // Seconds spent in each stage this frame
+    float window[PROFILE_STAGE_COUNT][PROFILE_WINDOW];  // Milliseconds, ring of the last rendered frames
+    int window_count, window_next;
+    long long frame_index;
+    bool show_hud;
+    FILE* csv;
+    double start_time;
+} FrameProfiler;
+
+FrameProfiler g_profiler;
+
+static void profile_begin_frame(void) {
+    memset(g_profiler.current, 0, sizeof(g_profiler.current));
+    g_profiler.frame_start = al_get_time();
+}
+
+// Adds the time since start (an earlier al_get_time()) to a stage of the current frame.
+static void profile_add(ProfileStage stage, double start) { g_profiler.current[stage] += al_get_time() - start; }
+
+static bool profile_open_csv(const char* path) {
+    g_profiler.csv = fopen(path, "w");
+    if (!g_profiler.csv) { app_log(true, "ERROR", "Could not open profile CSV '%s'.", path); return false; }
+    setvbuf(g_profiler.csv, NULL, _IOFBF, PROFILE_CSV_BUFFER); // Rows reach the disk in large writes, not once per frame
+    fprintf(g_profiler.csv, "frame,time_s,mode,faces,rendered");
+    for (int s = 0; s < PROFILE_STAGE_COUNT; ++s) fprintf(g_profiler.csv, ",%s_ms", k_profile_stage_names[s]);
+    fputc('\n', g_profiler.csv);
+    g_profiler.start_time = al_get_time();
+    app_log(true, "INFO", "Writing per-frame timings to %s", path);
+    return true;
+}
+
+static void profile_close(void) {
+    if (g_profiler.csv) fclose(g_profiler.csv);
+    g_profiler.csv = NULL;
+}
+
+// Closes the current frame. rendered says whether the model was drawn this frame or only blitted from the frame cache.
+static void profile_end_frame(bool rendered, const char* mode, int face_count) {
+    FrameProfiler* p = &g_profiler;
+    p->current[PROFILE_FRAME] = al_get_time() - p->frame_start;
+    if (rendered) {
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s) p->window[s][p->window_next] = (float)(p->current[s] * 1000.0);
+        p->window_next = (p->window_next + 1) % PROFILE_WINDOW;
+        if (p->window_count < PROFILE_WINDOW) p->window_count++;
+    }
+    if (p->csv) {
+        fprintf(p->csv, "%lld,%.6f,%s,%d,%d", p->frame_index, p->frame_start - p->start_time, mode, face_count, rendered ? 1 : 0);
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s) fprintf(p->csv, ",%.4f", p->current[s] * 1000.0);
+        fputc('\n', p->csv);
+    }
+    p->frame_index++;
+}
+
+static int compare_floats(const void* a, const void* b) {
+    float fa = *(const float*)a, fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+// Table of the last frame and the rolling min/avg/p99 per stage, in milliseconds, starting at y.
+static void draw_profile_hud(ALLEGRO_FONT* font, float y) {
+    const FrameProfiler* p = &g_profiler;
+    if (!font || !p->show_hud) return;
+    static const char* const headers[4] = { "last", "min", "avg", "p99" };
+    float line_height = (float)al_get_font_line_height(font) + 2.0f;
+    ALLEGRO_COLOR color = al_map_rgb(0, 255, 255);
+    al_draw_textf(font, color, 10, y, 0, "ms (%d frames)", p->window_count);
+    for (int c = 0; c < 4; ++c) al_draw_text(font, color, 180 + c * 70.0f, y, ALLEGRO_ALIGN_RIGHT, headers[c]);
+    float sorted[PROFILE_WINDOW];
+    int n = p->window_count;
+    int last = (p->window_next + PROFILE_WINDOW - 1) % PROFILE_WINDOW;
+    for (int s = 0; s < PROFILE_STAGE_COUNT && n > 0; ++s) {
+        double sum = 0.0;
+        for (int i = 0; i < n; ++i) { sorted[i] = p->window[s][i]; sum += sorted[i]; }
+        qsort(sorted, (size_t)n, sizeof(float), compare_floats);
+        float values[4] = { p->window[s][last], sorted[0], (float)(sum / n), sorted[clamp_int((int)ceil(n * 0.99) - 1, 0, n - 1)] };
+        float row_y = y + line_height * (s + 1);
+        al_draw_text(font, color, 10, row_y, 0, k_profile_stage_names[s]);
+        for (int c = 0; c < 4; ++c) al_draw_textf(font, color, 180 + c * 70.0f, row_y, ALLEGRO_ALIGN_RIGHT, "%.2f", values[c]);
+    }
+}
+
+// --- Painter's Algorithm Renderer ---
+// Sorts front-facing faces back to front by average depth and draws them in one batch. Expects mesh->transformed
+// to hold the vertices projected by view.
+static void render_model_painter(const RenderMesh* mesh, const ViewTransform* view) {
+    const float* tx = mesh->transformed.x; const float* ty = mesh->transformed.y; const float* tz = mesh->transformed.z;
+    if (!ensure_depth_key_capacity(mesh->num_faces)) return;
+    double stage_start = al_get_time();
+    FaceShading shading = face_shading_for_view(view);
+    int sorted_face_count = 0, range_count = render_range_count(mesh);
+    for (int n = 0; n < range_count; ++n) {
+        int end;
+        for (int i = render_range(mesh, n, &end); i < end; ++i) {
+            if (!face_corners_valid(&mesh->faces[i], mesh->num_vertices)) continue; // Skip if invalid
+            if (face_is_culled(&shading, &mesh->faces[i], tx, ty)) continue;
+            depth_keys[sorted_face_count].key = depth_sort_key((tz[mesh->faces[i].v_idx[0]] + tz[mesh->faces[i].v_idx[1]] + tz[mesh->faces[i].v_idx[2]]) / 3.0f);
+            depth_keys[sorted_face_count].face = i;
+            sorted_face_count++;
+        }
+    }
+    profile_add(PROFILE_SHADE, stage_start);
+
+    stage_start = al_get_time();
+    radix_sort_depth_keys(sorted_face_count);
+    profile_add(PROFILE_SORT, stage_start);
+
+    stage_start = al_get_time();
+    ALLEGRO_VERTEX* batch_vertices = triangle_batch_begin(sorted_face_count * 3, mesh->num_faces);
+    for (int s = 0; s < sorted_face_count && batch_vertices; ++s) {
+        const Face* face = &mesh->faces[depth_keys[s].face];
+
+        float light_val_draw = face_light_intensity(&shading, face->normal) * (1.0f / 255.0f); // Also rescales the 8-bit channels
+
+        ALLEGRO_VERTEX* tri_verts_allegro = &batch_vertices[s * 3]; // Allegro's vertex type
+        for (int k = 0; k < 3; ++k) {
+            int vi = face->v_idx[k];
+            uint32_t base = mesh->colors[vi];
+            ALLEGRO_VERTEX* out = &tri_verts_allegro[k];
+            out->x = tx[vi] + SCREEN_W / 2.0f;
+            out->y = -ty[vi] + SCREEN_H / 2.0f;
+            out->z = 0;
+            out->color.r = (float)RGBA8_R(base) * light_val_draw; // Written in place; no al_map/al_unmap round trip per vertex
+            out->color.g = (float)RGBA8_G(base) * light_val_draw;
+            out->color.b = (float)RGBA8_B(base) * light_val_draw;
+            out->color.a = (float)RGBA8_A(base) * (1.0f / 255.0f);
+        }
+    }
+    if (batch_vertices) triangle_batch_submit(sorted_face_count * 3);
+    profile_add(PROFILE_DRAW, stage_start);
+}
+
+// --- Software Rasterizer (Z-buffer mode) ---
+// Faces are lit and binned into screen tiles in parallel, then each tile is rasterized with a per-pixel depth
+// test by one worker, straight into a locked bitmap. Smaller z is closer to the viewer, as in painter mode.
+#define RASTER_TILE_SIZE 64
+#define RASTER_TILES_X ((SCREEN_W + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE)
+#define RASTER_TILES_Y ((SCREEN_H + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE)
+#define RASTER_TILE_COUNT (RASTER_TILES_X * RASTER_TILES_Y)
+#define RASTER_SETUP_RANGES 128 // Face ranges (see render_range()) per setup/binning job, about 16k faces
+
+typedef enum { RENDER_MODE_PAINTER, RENDER_MODE_ZBUFFER } RenderMode;
+
+typedef struct {
+    int16_t x0, y0, x1, y1; // Inclusive tile range covered by the face; x0 > x1 and y0 > y1 when the face is skipped
+} TileRect;
+
+typedef struct {
+    ALLEGRO_BITMAP* bitmap;
+    unsigned char* pixels; // Locked ABGR_8888 rows while a frame is being rasterized
+    int pitch;
+    float* depth;          // SCREEN_W * SCREEN_H
+    float* face_light;     // Lighting factor per face
+    TileRect* face_tiles;
+    int face_capacity;
+    int* block_tile_counts; // [block][tile] counts, turned into write offsets before the scatter pass
+    int block_capacity;
+    int* tile_start;       // RASTER_TILE_COUNT + 1 offsets into tile_faces
+    int* tile_faces;
+    int tile_face_capacity;
+    int block_count;
+    int range_count;
+    const RenderMesh* mesh; // Mesh being rasterized this frame
+} SoftwareRasterizer;
+
+RenderMode g_render_mode = RENDER_MODE_PAINTER;
+SoftwareRasterizer g_rasterizer;
+
+static uint32_t pack_abgr8888(float r, float g, float b) {
+    uint32_t ri = (uint32_t)(fminf(1.0f, fmaxf(0.0f, r)) * 255.0f + 0.5f);
+    uint32_t gi = (uint32_t)(fminf(1.0f, fmaxf(0.0f, g)) * 255.0f + 0.5f);
+    uint32_t bi = (uint32_t)(fminf(1.0f, fmaxf(0.0f, b)) * 255.0f + 0.5f);
+    return 0xFF000000u | (bi << 16) | (gi << 8) | ri;
+}
+
+// Pass 1: per-face culling, light and tile range, plus per-block tile counts. context is the frame's FaceShading.
+static void raster_setup_job(void* context, int block) {
+    const FaceShading* shading = (const FaceShading*)context; SoftwareRasterizer* r = &g_rasterizer; const RenderMesh* mesh = r->mesh;
+    const float* tx = mesh->transformed.x; const float* ty = mesh->transformed.y; const float* tz = mesh->transformed.z;
+    int* counts = &r->block_tile_counts[block * RASTER_TILE_COUNT];
+    memset(counts, 0, RASTER_TILE_COUNT * sizeof(int));
+    int first_range = block * RASTER_SETUP_RANGES, last_range = first_range + RASTER_SETUP_RANGES < r->range_count ? first_range + RASTER_SETUP_RANGES : r->range_count;
+    for (int n = first_range; n < last_range; ++n) {
+        int end;
+        for (int i = render_range(mesh, n, &end); i < end; ++i) {
+            TileRect* rect = &r->face_tiles[i];
+            rect->x0 = rect->y0 = 1; rect->x1 = rect->y1 = 0; // Empty in both axes, so the bin pass loops over nothing
+            int i0 = mesh->faces[i].v_idx[0], i1 = mesh->faces[i].v_idx[1], i2 = mesh->faces[i].v_idx[2];
+            if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= mesh->num_vertices || i1 >= mesh->num_vertices || i2 >= mesh->num_vertices) continue;
+            if (face_is_culled(shading, &mesh->faces[i], tx, ty)) continue;
+            Point3D p0 = { tx[i0], ty[i0], tz[i0] }; Point3D p1 = { tx[i1], ty[i1], tz[i1] }; Point3D p2 = { tx[i2], ty[i2], tz[i2] };
+            r->face_light[i] = face_light_intensity(shading, mesh->faces[i].normal);
+
+            float sx_min = fminf(p0.x, fminf(p1.x, p2.x)) + SCREEN_W / 2.0f, sx_max = fmaxf(p0.x, fmaxf(p1.x, p2.x)) + SCREEN_W / 2.0f;
+            float sy_min = -fmaxf(p0.y, fmaxf(p1.y, p2.y)) + SCREEN_H / 2.0f, sy_max = -fminf(p0.y, fminf(p1.y, p2.y)) + SCREEN_H / 2.0f;
+            if (!(sx_max >= 0.0f && sy_max >= 0.0f && sx_min < (float)SCREEN_W && sy_min < (float)SCREEN_H)) continue; // Offscreen or NaN
+            rect->x0 = (int16_t)clamp_int((int)sx_min / RASTER_TILE_SIZE, 0, RASTER_TILES_X - 1);
+            rect->x1 = (int16_t)clamp_int((int)sx_max / RASTER_TILE_SIZE, 0, RASTER_TILES_X - 1);
+            rect->y0 = (int16_t)clamp_int((int)sy_min / RASTER_TILE_SIZE, 0, RASTER_TILES_Y - 1);
+            rect->y1 = (int16_t)clamp_int((int)sy_max / RASTER_TILE_SIZE, 0, RASTER_TILES_Y - 1);
+            for (int ty_i = rect->y0; ty_i <= rect->y1; ++ty_i)
+                for (int tx_i = rect->x0; tx_i <= rect->x1; ++tx_i) counts[ty_i * RASTER_TILES_X + tx_i]++;
+        }
+    }
+}
+
+// Pass 2: scatter face indices into the tile lists using the offsets computed from pass 1.
+static void raster_bin_job(void* context, int block) {
+    (void)context; SoftwareRasterizer* r = &g_rasterizer; const RenderMesh* mesh = r->mesh;
+    int* offsets = &r->block_tile_counts[block * RASTER_TILE_COUNT];
+    int first_range = block * RASTER_SETUP_RANGES, last_range = first_range + RASTER_SETUP_RANGES < r->range_count ? first_range + RASTER_SETUP_RANGES : r->range_count;
+    for (int n = first_range; n < last_range; ++n) {
+        int end;
+        for (int i = render_range(mesh, n, &end); i < end; ++i) {
+            const TileRect* rect = &r->face_tiles[i];
+            for (int ty_i = rect->y0; ty_i <= rect->y1; ++ty_i)
+                for (int tx_i = rect->x0; tx_i <= rect->x1; ++tx_i) r->tile_faces[offsets[ty_i * RASTER_TILES_X + tx_i]++] = i;
+        }
+    }
+}
+
+// Pass 3: clear one tile, then rasterize its faces with edge functions sampled at pixel centers.
+static void raster_tile_job(void* context, int tile) {
+    (void)context; SoftwareRasterizer* r = &g_rasterizer; const RenderMesh* mesh = r->mesh;
+    const float* tx = mesh->transformed.x; const float* ty = mesh->transformed.y; const float* tz = mesh->transformed.z;
+    int tile_x0 = (tile % RASTER_TILES_X) * RASTER_TILE_SIZE, tile_y0 = (tile / RASTER_TILES_X) * RASTER_TILE_SIZE;
+    int tile_x1 = tile_x0 + RASTER_TILE_SIZE < SCREEN_W ? tile_x0 + RASTER_TILE_SIZE : SCREEN_W; // Exclusive
+    int tile_y1 = tile_y0 + RASTER_TILE_SIZE < SCREEN_H ? tile_y0 + RASTER_TILE_SIZE : SCREEN_H;
+
+    uint32_t background = pack_abgr8888(30 / 255.0f, 30 / 255.0f, 30 / 255.0f);
+    for (int y = tile_y0; y < tile_y1; ++y) {
+        uint32_t* row = (uint32_t*)(r->pixels + (ptrdiff_t)y * r->pitch);
+        float* depth_row = &r->depth[y * SCREEN_W];
+        for (int x = tile_x0; x < tile_x1; ++x) { row[x] = background; depth_row[x] = FLT_MAX; }
+    }
+
+    for (int n = r->tile_start[tile]; n < r->tile_start[tile + 1]; ++n) {
+        int f = r->tile_faces[n];
+        int vi[3] = { mesh->faces[f].v_idx[0], mesh->faces[f].v_idx[1], mesh->faces[f].v_idx[2] };
+        float sx[3], sy[3], sz[3];
+        for (int k = 0; k < 3; ++k) { sx[k] = tx[vi[k]] + SCREEN_W / 2.0f; sy[k] = -ty[vi[k]] + SCREEN_H / 2.0f; sz[k] = tz[vi[k]]; }
+        float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+        if (!(fabsf(area) > 1e-8f)) continue;
+        if (area < 0.0f) { // Make the winding consistent so all inside tests are >= 0
+            float t; int ti;
+            t = sx[1]; sx[1] = sx[2]; sx[2] = t; t = sy[1]; sy[1] = sy[2]; sy[2] = t; t = sz[1]; sz[1] = sz[2]; sz[2] = t;
+            ti = vi[1]; vi[1] = vi[2]; vi[2] = ti; area = -area;
+        }
+        int min_x = clamp_int((int)floorf(fminf(sx[0], fminf(sx[1], sx[2]))), tile_x0, tile_x1 - 1);
+        int max_x = clamp_int((int)ceilf(fmaxf(sx[0], fmaxf(sx[1], sx[2]))), tile_x0, tile_x1 - 1);
+        int min_y = clamp_int((int)floorf(fminf(sy[0], fminf(sy[1], sy[2]))), tile_y0, tile_y1 - 1);
+        int max_y = clamp_int((int)ceilf(fmaxf(sy[0], fmaxf(sy[1], sy[2]))), tile_y0, tile_y1 - 1);
+
+        float light = r->face_light[f]; float inv_area = 1.0f / area;
+        float cr[3], cg[3], cb[3];
+        float channel_scale = light * (1.0f / 255.0f);
+        for (int k = 0; k < 3; ++k) { uint32_t c = mesh->colors[vi[k]]; cr[k] = RGBA8_R(c) * channel_scale; cg[k] = RGBA8_G(c) * channel_scale; cb[k] = RGBA8_B(c) * channel_scale; }
+
+        // Edge function for edge (a -> b): (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x), weight of the opposite vertex
+        float px = min_x + 0.5f, py = min_y + 0.5f;
+        float e0_dx = -(sy[2] - sy[1]), e0_dy = sx[2] - sx[1];
+        float e1_dx = -(sy[0] - sy[2]), e1_dy = sx[0] - sx[2];
+        float e2_dx = -(sy[1] - sy[0]), e2_dy = sx[1] - sx[0];
+        float w0_row = (sx[2] - sx[1]) * (py - sy[1]) - (sy[2] - sy[1]) * (px - sx[1]);
+        float w1_row = (sx[0] - sx[2]) * (py - sy[2]) - (sy[0] - sy[2]) * (px - sx[2]);
+        float w2_row = (sx[1] - sx[0]) * (py - sy[0]) - (sy[1] - sy[0]) * (px - sx[0]);
+        for (int y = min_y; y <= max_y; ++y) {
+            uint32_t* row = (uint32_t*)(r->pixels + (ptrdiff_t)y * r->pitch);
+            float* depth_row = &r->depth[y * SCREEN_W];
+            float w0 = w0_row, w1 = w1_row, w2 = w2_row;
+            for (int x = min_x; x <= max_x; ++x) {
+                if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) {
+                    float b0 = w0 * inv_area, b1 = w1 * inv_area, b2 = w2 * inv_area;
+                    float z = b0 * sz[0] + b1 * sz[1] + b2 * sz[2];
+                    if (z < depth_row[x]) {
+                        depth_row[x] = z;
+                        row[x] = pack_abgr8888(b0 * cr[0] + b1 * cr[1] + b2 * cr[2], b0 * cg[0] + b1 * cg[1] + b2 * cg[2], b0 * cb[0] + b1 * cb[1] + b2 * cb[2]);
+                    }
+                }
+                w0 += e0_dx; w1 += e1_dx; w2 += e2_dx;
+            }
+            w0_row += e0_dy; w1_row += e1_dy; w2_row += e2_dy;
+        }
+    }
+}
+
+static bool rasterizer_reserve(const RenderMesh* mesh) {
+    SoftwareRasterizer* r = &g_rasterizer;
+    if (!r->bitmap) {
+        r->bitmap = al_create_bitmap(SCREEN_W, SCREEN_H);
+        if (!r->bitmap) { app_log(true, "ERROR", "Failed to create the software rasterizer target bitmap."); return false; }
+    }
+    if (!r->depth) {
+        r->depth = (float*)malloc((size_t)SCREEN_W * SCREEN_H * sizeof(float));
+        r->tile_start = (int*)malloc((RASTER_TILE_COUNT + 1) * sizeof(int));
+        if (!r->depth || !r->tile_start) { app_log(true, "ERROR", "Failed to allocate the depth buffer."); return false; }
+    }
+    if (r->face_capacity < mesh->num_faces) {
+        float* light = (float*)realloc(r->face_light, (size_t)mesh->num_faces * sizeof(float));
+        if (light) r->face_light = light;
+        TileRect* tiles = (TileRect*)realloc(r->face_tiles, (size_t)mesh->num_faces * sizeof(TileRect));
+        if (tiles) r->face_tiles = tiles;
+        if (!light || !tiles) { app_log(true, "ERROR", "Failed to allocate rasterizer face data for %d faces.", mesh->num_faces); return false; }
+        r->face_capacity = mesh->num_faces;
+    }
+    r->range_count = render_range_count(mesh);
+    r->block_count = (r->range_count + RASTER_SETUP_RANGES - 1) / RASTER_SETUP_RANGES;
+    if (r->block_capacity < r->block_count) {
+        int* counts = (int*)realloc(r->block_tile_counts, (size_t)r->block_count * RASTER_TILE_COUNT * sizeof(int));
+        if (!counts) { app_log(true, "ERROR", "Failed to allocate rasterizer bins."); return false; }
+        r->block_tile_counts = counts; r->block_capacity = r->block_count;
+    }
+    return true;
+}
+
+static void rasterizer_release(void) {
+    SoftwareRasterizer* r = &g_rasterizer;
+    if (r->bitmap) al_destroy_bitmap(r->bitmap);
+    free(r->depth); free(r->face_light); free(r->face_tiles); free(r->block_tile_counts); free(r->tile_start); free(r->tile_faces);
+    memset(r, 0, sizeof(*r));
+}
+
+// Renders the mesh into the rasterizer bitmap and draws it at the origin. Expects mesh->transformed to hold the
+// vertices projected by view.
+static void render_model_zbuffer(const RenderMesh* mesh, const ViewTransform* view) {
+    SoftwareRasterizer* r = &g_rasterizer;
+    if (!rasterizer_reserve(mesh)) return;
+    r->mesh = mesh;
+    double stage_start = al_get_time();
+    FaceShading shading = face_shading_for_view(view);
+    parallel_for(r->block_count, raster_setup_job, &shading);
+    profile_add(PROFILE_SHADE, stage_start);
+
+    stage_start = al_get_time();
+    // Turn per-block counts into write offsets: tiles are laid out one after another, blocks in order within a tile
+    long long total = 0;
+    for (int t = 0; t < RASTER_TILE_COUNT; ++t) {
+        r->tile_start[t] = (int)total;
+        for (int b = 0; b < r->block_count; ++b) {
+            int* slot = &r->block_tile_counts[b * RASTER_TILE_COUNT + t];
+            int count = *slot; *slot = (int)total; total += count;
+        }
+    }
+    if (total > INT_MAX) { app_log(true, "ERROR", "Too many binned triangles (%lld) for the software rasterizer.", total); return; }
+    r->tile_start[RASTER_TILE_COUNT] = (int)total;
+    if (r->tile_face_capacity < (int)total) {
+        int new_capacity = (int)fmin((double)total * 1.25 + 1024, (double)INT_MAX);
+        int* grown = (int*)realloc(r->tile_faces, (size_t)new_capacity * sizeof(int));
+        if (!grown) { app_log(true, "ERROR", "Failed to allocate %lld tile bin entries.", total); return; }
+        r->tile_faces = grown; r->tile_face_capacity = new_capacity;
+    }
+    parallel_for(r->block_count, raster_bin_job, NULL);
+    profile_add(PROFILE_SORT, stage_start);
+
+    stage_start = al_get_time();
+    ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(r->bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_WRITEONLY);
+    if (!region) { app_log(true, "ERROR", "Failed to lock the software rasterizer bitmap."); return; }
+    r->pixels = (unsigned char*)region->data; r->pitch = region->pitch;
+    parallel_for(RASTER_TILE_COUNT, raster_tile_job, NULL);
+    al_unlock_bitmap(r->bitmap);
+    r->pixels = NULL; r->mesh = NULL;
+    al_draw_bitmap(r->bitmap, 0, 0, 0);
+    profile_add(PROFILE_DRAW, stage_start);
+}
+
+// --- Frame Cache ---
+// The rendered model is kept in an offscreen bitmap. Idle timer ticks only blit it and draw the HUD on top; the
+// transform/sort/draw pipeline re-runs after invalidate_frame_cache() (drag, render setting change, reload, or
+// anything that may have lost or resized the display's video memory).
+ALLEGRO_BITMAP* g_frame_cache = NULL;
+bool g_frame_cache_dirty = true;
+
+static void invalidate_frame_cache(void) { g_frame_cache_dirty = true; }
+
+// Makes sure the cache matches the display size. Returns false if no cache bitmap is available, in which case the
+// caller renders straight to the backbuffer every frame.
+static bool ensure_frame_cache(ALLEGRO_DISPLAY* display) {
+    int w = al_get_display_width(display), h = al_get_display_height(display);
+    if (g_frame_cache && (al_get_bitmap_width(g_frame_cache) != w || al_get_bitmap_height(g_frame_cache) != h)) {
+        al_destroy_bitmap(g_frame_cache); g_frame_cache = NULL;
+    }
+    if (!g_frame_cache) {
+        g_frame_cache = al_create_bitmap(w, h);
+        if (!g_frame_cache) { app_log(true, "WARN", "Failed to create %dx%d frame cache bitmap; redrawing every frame.", w, h); return false; }
+        g_frame_cache_dirty = true;
+    }
+    return true;
+}
+
+static void release_frame_cache(void) {
+    if (g_frame_cache) al_destroy_bitmap(g_frame_cache);
+    g_frame_cache = NULL; g_frame_cache_dirty = true;
+}
+
+// --- Headless Benchmark ---
+// --benchmark loads the STL and renders a fixed sequence of seeded random orientations with both renderers into an
+// offscreen memory bitmap. No display is created, no input is installed and the event loop never runs, so it works on
+// build machines without a desktop session. Load time, per-frame percentiles and triangles per second are printed as
+// JSON (or written to --benchmark-json=<file>); --profile-csv still records every frame.
+#define BENCHMARK_DEFAULT_FRAMES 200
+#define BENCHMARK_WARMUP_FRAMES 5 // Untimed; the first frames grow the depth, sort and draw buffers
+
+typedef struct {
+    int frames;
+    uint32_t seed;
+    const char* json_path; // NULL: stdout
+    const char* profile_csv_path;
+} BenchmarkOptions;
+
+static uint32_t benchmark_random(uint32_t* state) { // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    return *state = x;
+}
+
+static float benchmark_random_unit(uint32_t* state) { return (float)(benchmark_random(state) >> 8) * (1.0f / 16777216.0f); }
+
+// Uniformly distributed rotation (Shoemake's method).
+static Quaternion benchmark_orientation(uint32_t* state) {
+    float u1 = benchmark_random_unit(state), u2 = benchmark_random_unit(state), u3 = benchmark_random_unit(state);
+    float s1 = sqrtf(1.0f - u1), s2 = sqrtf(u1);
+    return (Quaternion) { s2 * cosf(2.0f * (float)M_PI * u3), s1 * sinf(2.0f * (float)M_PI * u2), s1 * cosf(2.0f * (float)M_PI * u2), s2 * sinf(2.0f * (float)M_PI * u3) };
+}
+
+static double benchmark_percentile(const double* sorted, int n, double fraction) { return sorted[clamp_int((int)ceil(n * fraction) - 1, 0, n - 1)]; }
+
+static int compare_doubles(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+// JSON string with everything outside printable ASCII escaped; bytes >= 0x80 are taken as Latin-1.
+static void json_write_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (const unsigned char* p = (const unsigned char*)s; *p; ++p) {
+        if (*p == '"' || *p == '\\') fprintf(out, "\\%c", *p);
+        else if (*p < 0x20 || *p >= 0x7F) fprintf(out, "\\u%04x", *p);
+        else fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+// Renders every orientation once in the current g_render_mode and writes the mode's JSON object.
+static bool benchmark_mode(FILE* out, const Quaternion* orientations, int frames, double* frame_seconds) {
+    RenderMesh mesh = full_render_mesh();
+    const char* mode = g_render_mode == RENDER_MODE_ZBUFFER ? "zbuffer" : "painter";
+    double stage_sums[PROFILE_STAGE_COUNT] = { 0 };
+    for (int f = -BENCHMARK_WARMUP_FRAMES; f < frames; ++f) {
+        profile_begin_frame();
+        al_clear_to_color(al_map_rgb(30, 30, 30));
+        ViewTransform view = camera_view(orientations[f < 0 ? 0 : f]);
+        double transform_start = al_get_time();
+        transform_render_mesh(&view, &mesh);
+        profile_add(PROFILE_TRANSFORM, transform_start);
+        if (g_render_mode == RENDER_MODE_ZBUFFER) render_model_zbuffer(&mesh, &view);
+        else render_model_painter(&mesh, &view);
+        if (f < 0) continue;
+        profile_end_frame(true, mode, mesh.num_faces);
+        frame_seconds[f] = g_profiler.current[PROFILE_FRAME];
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s) stage_sums[s] += g_profiler.current[s];
+    }
+    double total = stage_sums[PROFILE_FRAME];
+    qsort(frame_seconds, (size_t)frames, sizeof(double), compare_doubles);
+    fprintf(out, "    {\"mode\": \"%s\", \"frame_ms\": {\"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f}, \"stage_mean_ms\": {",
+        mode, frame_seconds[0] * 1000.0, benchmark_percentile(frame_seconds, frames, 0.50) * 1000.0, benchmark_percentile(frame_seconds, frames, 0.90) * 1000.0,
+        benchmark_percentile(frame_seconds, frames, 0.99) * 1000.0, frame_seconds[frames - 1] * 1000.0, total / frames * 1000.0);
+    for (int s = 0; s < PROFILE_FRAME; ++s) fprintf(out, "%s\"%s\": %.4f", s ? ", " : "", k_profile_stage_names[s], stage_sums[s] / frames * 1000.0);
+    fprintf(out, "}, \"triangles_per_second\": %.0f}", total > 0.0 ? (double)mesh.num_faces * frames / total : 0.0);
+    app_log(true, "INFO", "Benchmark %s: %d frames, mean %.3f ms, p99 %.3f ms.", mode, frames, total / frames * 1000.0, benchmark_percentile(frame_seconds, frames, 0.99) * 1000.0);
+    return true;
+}
+
+// Runs the whole benchmark. Returns the process exit code.
+static int run_benchmark(const char* stl_filename, const BenchmarkOptions* options) {
+    if (!al_init() || !al_init_primitives_addon()) { app_log(true, "ERROR", "Failed to initialize Allegro for the benchmark."); return 1; }
+    log_start_writer();
+    worker_pool_init();
+    if (options->profile_csv_path) profile_open_csv(options->profile_csv_path);
+    app_log(true, "INFO", "Benchmark: %s, %d frames, seed %u.", stl_filename, options->frames, options->seed);
+
+    double load_start = al_get_time();
+    if (!load_stl(stl_filename, NULL)) { app_log(true, "ERROR", "Benchmark aborted: could not load %s.", stl_filename); profile_close(); return 1; }
+    double load_seconds = al_get_time() - load_start;
+
+    al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+    ALLEGRO_BITMAP* target = al_create_bitmap(SCREEN_W, SCREEN_H);
+    Quaternion* orientations = (Quaternion*)malloc((size_t)options->frames * sizeof(Quaternion));
+    double* frame_seconds = (double*)malloc((size_t)options->frames * sizeof(double));
+    FILE* out = options->json_path ? fopen(options->json_path, "w") : stdout;
+    int exit_code = 1;
+    if (!target || !orientations || !frame_seconds) app_log(true, "ERROR", "Benchmark aborted: out of memory for the offscreen target.");
+    else if (!out) app_log(true, "ERROR", "Benchmark aborted: could not open %s.", options->json_path);
+    else {
+        al_set_target_bitmap(target);
+        uint32_t state = options->seed ? options->seed : 0x9E3779B9u; // xorshift never leaves 0
+        for (int f = 0; f < options->frames; ++f) orientations[f] = benchmark_orientation(&state);
+        fprintf(out, "{\n  \"file\": "); json_write_string(out, stl_filename);
+        fprintf(out, ",\n  \"faces\": %d,\n  \"vertices\": %d,\n  \"load_seconds\": %.4f,\n  \"mesh_cache\": %s,\n", num_faces, num_vertices, load_seconds, g_mesh_cache_view.data ? "true" : "false");
+        fprintf(out, "  \"threads\": %d,\n  \"transform_kernel\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"seed\": %u,\n  \"frames\": %d,\n  \"backface_culling\": %s,\n",
+            worker_pool_size(), g_transform_kernel_name, SCREEN_W, SCREEN_H, options->seed, options->frames, g_backface_culling ? "true" : "false");
+        fprintf(out, "  \"camera\": {\"projection\": \"%s\", \"zoom\": %g},\n  \"modes\": [\n", g_camera.perspective ? "perspective" : "orthographic", g_camera.zoom);
+        g_render_mode = RENDER_MODE_PAINTER; benchmark_mode(out, orientations, options->frames, frame_seconds);
+        fprintf(out, ",\n");
+        g_render_mode = RENDER_MODE_ZBUFFER; benchmark_mode(out, orientations, options->frames, frame_seconds);
+        fprintf(out, "\n  ]\n}\n");
+        exit_code = ferror(out) ? 1 : 0;
+    }
+    if (out && out != stdout) fclose(out);
+    free(orientations); free(frame_seconds);
+    rasterizer_release();
+    if (target) al_destroy_bitmap(target);
+    cleanup_model_data();
+    worker_pool_shutdown();
+    profile_close();
+    al_shutdown_primitives_addon();
+    return exit_code;
+}
+
+// --- Batch Statistics ---
+// --stats audits many STL files without a display. Every argument that is not an option is a file, a directory
+// (searched recursively for .stl, .stl.gz and .stl.zst) or @list, a text file naming one path per line. Each file goes
+// through the viewer's own format detection and parsers, but its facets are reduced batch by batch into running sums
+// instead of filling the model globals, so files run concurrently as worker pool jobs (largest first, to even out the
+// tail) in bounded memory. The parallelism is across files; one file is parsed on one thread. One row per file is
+// written in input order as JSON lines, or as CSV with --stats-format=csv, to stdout or --stats-out=<file>.
+#define STATS_BATCH_FACES 4096               // Facets per reduction kernel call
+#define STATS_ASCII_WINDOW ((size_t)8 << 20) // Bytes of text parsed per step
+#define STATS_DEGENERATE_SINE 1e-6f          // A face whose corner angle has a smaller sine is degenerate
+#define STATS_MAX_DIRECTORY_DEPTH 64         // Guards against symlink loops
+
+typedef enum { STATS_FORMAT_JSON, STATS_FORMAT_CSV } StatsFormat;
+
+typedef struct {
+    StatsFormat format;
+    const char* out_path; // NULL: stdout
+    bool allow_simd;
+} StatsOptions;
+
+typedef struct {
+    double area2;   // Twice the surface area
+    double volume6; // Six times the signed enclosed volume, measured from the origin passed to the kernel
+    long long valid_faces;
+} FacetSums;
+
+typedef void (*FacetSumsKernelFn)(const VertexPositions* p, int begin, int end, const float origin[3], FacetSums* sums);
+
+// Adds facets [begin, end) of p (three consecutive vertices each) to sums. Degenerate faces (corners collinear to
+// within STATS_DEGENERATE_SINE, or not finite) add nothing and are left out of valid_faces. Corners are taken
+// relative to origin so the volume terms of a model far from (0, 0, 0) do not cancel away in float.
+static void facet_sums_scalar(const VertexPositions* p, int begin, int end, const float origin[3], FacetSums* sums) {
+    const float eps2 = STATS_DEGENERATE_SINE * STATS_DEGENERATE_SINE;
+    for (int f = begin; f < end; ++f) {
+        int i = f * 3;
+        float e1x = p->x[i + 1] - p->x[i], e1y = p->y[i + 1] - p->y[i], e1z = p->z[i + 1] - p->z[i];
+        float e2x = p->x[i + 2] - p->x[i], e2y = p->y[i + 2] - p->y[i], e2z = p->z[i + 2] - p->z[i];
+        float nx = e1y * e2z - e1z * e2y, ny = e1z * e2x - e1x * e2z, nz = e1x * e2y - e1y * e2x;
+        float n2 = nx * nx + ny * ny + nz * nz;
+        if (!(n2 > eps2 * (e1x * e1x + e1y * e1y + e1z * e1z) * (e2x * e2x + e2y * e2y + e2z * e2z))) continue; // Also catches NaN
+        sums->area2 += sqrtf(n2);
+        sums->volume6 += (p->x[i] - origin[0]) * nx + (p->y[i] - origin[1]) * ny + (p->z[i] - origin[2]) * nz;
+        sums->valid_faces++;
+    }
+}
+
+#ifdef STL_VIEWER_X86_SIMD
+// Splits 24 consecutive floats into every third one from offsets 0, 1 and 2: corners a, b and c of eight facets.
+TARGET_AVX2 static void deinterleave3_avx2(const float* p, __m256* a, __m256* b, __m256* c) {
+    __m256 v0 = _mm256_loadu_ps(p), v1 = _mm256_loadu_ps(p + 8), v2 = _mm256_loadu_ps(p + 16);
+    *a = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(v0, v1, 0x92), v2, 0x24), _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+    *b = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(v0, v1, 0x24), v2, 0x49), _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+    *c = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(v0, v1, 0x49), v2, 0x92), _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+}
+
+// Adds the eight float lanes of v into two double accumulators.
+TARGET_AVX2 static void accumulate_pd_avx2(__m256d* lo, __m256d* hi, __m256 v) {
+    *lo = _mm256_add_pd(*lo, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+    *hi = _mm256_add_pd(*hi, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+// Eight facets per step. Each face's terms are computed in float like the scalar kernel and summed in double lanes.
+TARGET_AVX2 static void facet_sums_avx2(const VertexPositions* p, int begin, int end, const float origin[3], FacetSums* sums) {
+    __m256 ox = _mm256_set1_ps(origin[0]), oy = _mm256_set1_ps(origin[1]), oz = _mm256_set1_ps(origin[2]);
+    __m256 eps2 = _mm256_set1_ps(STATS_DEGENERATE_SINE * STATS_DEGENERATE_SINE), one = _mm256_set1_ps(1.0f);
+    __m256d area2[2] = { _mm256_setzero_pd(), _mm256_setzero_pd() }, volume6[2] = { _mm256_setzero_pd(), _mm256_setzero_pd() };
+    __m256 valid = _mm256_setzero_ps(); // Exact: at most end - begin ones over eight lanes
+    int f = begin;
+    for (; f + 8 <= end; f += 8) {
+        __m256 ax, bx, cx, ay, by, cy, az, bz, cz;
+        deinterleave3_avx2(p->x + f * 3, &ax, &bx, &cx);
+        deinterleave3_avx2(p->y + f * 3, &ay, &by, &cy);
+        deinterleave3_avx2(p->z + f * 3, &az, &bz, &cz);
+        __m256 e1x = _mm256_sub_ps(bx, ax), e1y = _mm256_sub_ps(by, ay), e1z = _mm256_sub_ps(bz, az);
+        __m256 e2x = _mm256_sub_ps(cx, ax), e2y = _mm256_sub_ps(cy, ay), e2z = _mm256_sub_ps(cz, az);
+        __m256 nx = _mm256_fmsub_ps(e1y, e2z, _mm256_mul_ps(e1z, e2y));
+        __m256 ny = _mm256_fmsub_ps(e1z, e2x, _mm256_mul_ps(e1x, e2z));
+        __m256 nz = _mm256_fmsub_ps(e1x, e2y, _mm256_mul_ps(e1y, e2x));
+        __m256 n2 = _mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz)));
+        __m256 l1 = _mm256_fmadd_ps(e1x, e1x, _mm256_fmadd_ps(e1y, e1y, _mm256_mul_ps(e1z, e1z)));
+        __m256 l2 = _mm256_fmadd_ps(e2x, e2x, _mm256_fmadd_ps(e2y, e2y, _mm256_mul_ps(e2z, e2z)));
+        __m256 ok = _mm256_cmp_ps(n2, _mm256_mul_ps(eps2, _mm256_mul_ps(l1, l2)), _CMP_GT_OQ); // False for NaN
+        __m256 v6 = _mm256_fmadd_ps(_mm256_sub_ps(ax, ox), nx, _mm256_fmadd_ps(_mm256_sub_ps(ay, oy), ny, _mm256_mul_ps(_mm256_sub_ps(az, oz), nz)));
+        accumulate_pd_avx2(&area2[0], &area2[1], _mm256_and_ps(ok, _mm256_sqrt_ps(n2)));
+        accumulate_pd_avx2(&volume6[0], &volume6[1], _mm256_and_ps(ok, v6));
+        valid = _mm256_add_ps(valid, _mm256_and_ps(ok, one));
+    }
+    double lanes[2][4]; float valid_lanes[8];
+    _mm256_storeu_pd(lanes[0], _mm256_add_pd(area2[0], area2[1])); _mm256_storeu_pd(lanes[1], _mm256_add_pd(volume6[0], volume6[1]));
+    _mm256_storeu_ps(valid_lanes, valid);
+    for (int k = 0; k < 4; ++k) { sums->area2 += lanes[0][k]; sums->volume6 += lanes[1][k]; }
+    for (int k = 0; k < 8; ++k) sums->valid_faces += (long long)valid_lanes[k];
+    facet_sums_scalar(p, f, end, origin, sums);
+}
+#endif
+
+FacetSumsKernelFn g_facet_sums_kernel = facet_sums_scalar;
+const char* g_facet_sums_kernel_name = "scalar";
+
+static void select_facet_sums_kernel(bool allow_simd) {
+#ifdef STL_VIEWER_X86_SIMD
+    if (allow_simd && cpu_supports_avx2_fma()) { g_facet_sums_kernel = facet_sums_avx2; g_facet_sums_kernel_name = "AVX2"; }
+#else
+    (void)allow_simd;
+#endif
+    app_log(false, "DEBUG", "Facet statistics kernel: %s", g_facet_sums_kernel_name);
+}
+
+typedef struct {
+    char* path;
+    uint64_t bytes;
+    bool done, ok, binary, truncated;
+    StlCodec codec;
+    const char* error; // Set when !ok
+    long long faces, degenerate_faces;
+    Point3D min_coord, max_coord; // File units; min > max when no vertex was finite
+    double surface_area, volume, seconds;
+} StatsRow;
+
+typedef struct {
+    StatsRow* row;
+    VertexPositions batch; // STATS_BATCH_FACES facets, three vertices each
+    StlAsciiChunk chunk;   // Reused by every ASCII window
+    float origin[3];       // First finite vertex of the file
+    bool have_origin;
+    FacetSums sums;
+} StatsScan;
+
+static void stats_widen_bounds(StatsRow* row, Point3D lo, Point3D hi) {
+    row->min_coord.x = fminf(row->min_coord.x, lo.x); row->max_coord.x = fmaxf(row->max_coord.x, hi.x);
+    row->min_coord.y = fminf(row->min_coord.y, lo.y); row->max_coord.y = fmaxf(row->max_coord.y, hi.y);
+    row->min_coord.z = fminf(row->min_coord.z, lo.z); row->max_coord.z = fmaxf(row->max_coord.z, hi.z);
+}
+
+// Reduces the first count facets of s->batch.
+static void stats_add_batch(StatsScan* s, int count) {
+    const VertexPositions* p = &s->batch;
+    for (int i = 0; !s->have_origin && i < count * 3; ++i) {
+        if (!isfinite(p->x[i]) || !isfinite(p->y[i]) || !isfinite(p->z[i])) continue;
+        s->origin[0] = p->x[i]; s->origin[1] = p->y[i]; s->origin[2] = p->z[i]; s->have_origin = true;
+    } // Facets before the origin is found all have a non-finite corner and add nothing
+    g_facet_sums_kernel(p, 0, count, s->origin, &s->sums);
+    s->row->faces += count;
+}
+
+static void stats_scan_binary_records(StatsScan* s, const unsigned char* record, long long count) {
+    while (count > 0) {
+        int n = count < STATS_BATCH_FACES ? (int)count : STATS_BATCH_FACES;
+        stl_decode_binary_facets(record, n, &s->batch, 0, &s->row->min_coord, &s->row->max_coord);
+        stats_add_batch(s, n);
+        record += (size_t)n * STL_BINARY_FACET_SIZE; count -= n;
+    }
+}
+
+// Parses one facet-aligned piece of text, numbering its warnings with lines. Returns false when memory ran out.
+static bool stats_scan_ascii_text(StatsScan* s, StlLineCursor* lines, const char* text, size_t size) {
+    s->chunk.face_count = 0;
+    parse_stl_ascii_range(text, text + size, size, &s->chunk);
+    stl_log_ascii_warnings(&s->chunk, lines, text + size, (int)s->row->faces);
+    if (s->chunk.out_of_memory) return false;
+    stats_widen_bounds(s->row, s->chunk.min_coord, s->chunk.max_coord);
+    for (int first = 0; first < s->chunk.face_count; first += STATS_BATCH_FACES) {
+        int n = s->chunk.face_count - first < STATS_BATCH_FACES ? s->chunk.face_count - first : STATS_BATCH_FACES;
+        const Point3D* v = s->chunk.vertices + (size_t)first * 3;
+        for (int i = 0; i < n * 3; ++i) { s->batch.x[i] = v[i].x; s->batch.y[i] = v[i].y; s->batch.z[i] = v[i].z; }
+        stats_add_batch(s, n);
+    }
+    return true;
+}
+
+// Uncompressed file, straight out of the mapping.
+static bool stats_scan_mapped(StatsScan* s, const unsigned char* data, size_t size) {
+    StatsRow* row = s->row;
+    row->binary = stl_data_is_binary(data, size);
+    if (row->binary) {
+        uint64_t header_facets = read_u32_le(data + 80), available_facets = (size - STL_BINARY_HEADER_SIZE) / STL_BINARY_FACET_SIZE;
+        row->truncated = header_facets > available_facets;
+        stats_scan_binary_records(s, data + STL_BINARY_HEADER_SIZE, (long long)(row->truncated ? available_facets : header_facets));
+        return true;
+    }
+    const char* text = (const char*)data; const char* text_end = text + size;
+    StlLineCursor lines = { text, 1 };
+    for (const char* pos = text; pos < text_end; ) {
+        const char* window_end = (size_t)(text_end - pos) <= STATS_ASCII_WINDOW ? text_end : stl_align_to_facet(pos + STATS_ASCII_WINDOW, text_end);
+        if (!stats_scan_ascii_text(s, &lines, pos, (size_t)(window_end - pos))) { row->error = "out of memory"; return false; }
+        pos = window_end;
+    }
+    return true;
+}
+
+// Compressed file, decoded the way load_stl_compressed() does it.
+static bool stats_scan_compressed(StatsScan* s, const unsigned char* data, size_t size) {
+    StatsRow* row = s->row; StlDecoder d;
+    if (!stl_decoder_open(&d, row->codec, data, size)) {
+        row->error = row->codec == STL_CODEC_GZIP ? "gzip input needs a build with STL_VIEWER_WITH_ZLIB" : "zstd input needs a build with STL_VIEWER_WITH_ZSTD";
+        stl_decoder_close(&d); return false;
+    }
+    bool ok = stl_decoder_fill(&d, row->path, STL_TEXT_PROBE_BYTES);
+    if (ok) row->binary = stl_probe_is_binary(d.out, d.out_filled);
+    if (ok && row->binary) {
+        if (d.out_filled < STL_BINARY_HEADER_SIZE) { row->error = "too short for a binary STL header"; ok = false; }
+        else {
+            long long remaining = read_u32_le(d.out + 80);
+            stl_decoder_consume(&d, STL_BINARY_HEADER_SIZE);
+            while (remaining > 0 && (ok = stl_decoder_fill(&d, row->path, (size_t)STATS_BATCH_FACES * STL_BINARY_FACET_SIZE))) {
+                long long count = (long long)(d.out_filled / STL_BINARY_FACET_SIZE);
+                if (count > remaining) count = remaining;
+                if (count == 0) { row->truncated = true; break; }
+                stats_scan_binary_records(s, d.out, count);
+                stl_decoder_consume(&d, (size_t)count * STL_BINARY_FACET_SIZE);
+                remaining -= count;
+            }
+        }
+    }
+    else if (ok) {
+        size_t window = STATS_ASCII_WINDOW; StlLineCursor lines = { NULL, 1 };
+        while ((ok = stl_decoder_fill(&d, row->path, window)) && d.out_filled > 0) {
+            const char* text = (const char*)d.out; const char* text_end = text + d.out_filled;
+            const char* window_end = d.at_end ? text_end : stl_last_facet_start(text, text_end);
+            if (window_end == text) { window *= 2; continue; } // Not even one whole facet yet
+            lines.text = text;
+            if (!(ok = stats_scan_ascii_text(s, &lines, text, (size_t)(window_end - text)))) break;
+            stl_line_cursor_advance(&lines, window_end);
+            stl_decoder_consume(&d, (size_t)(window_end - text));
+        }
+    }
+    if (!ok && !row->error) row->error = d.failed ? "corrupt or truncated compressed data" : "out of memory";
+    stl_decoder_close(&d);
+    return ok;
+}
+
+// Fills in everything but path, bytes and done. Safe to run on several files at once.
+static void stats_scan_file(StatsRow* row) {
+    double start = al_get_time();
+    row->min_coord = (Point3D){ FLT_MAX, FLT_MAX, FLT_MAX }; row->max_coord = (Point3D){ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    StatsScan s; memset(&s, 0, sizeof(s)); s.row = row;
+    MappedFile mf; bool ok = false;
+    if (!alloc_vertex_positions(&s.batch, STATS_BATCH_FACES * 3)) row->error = "out of memory";
+    else if (!map_file_readonly(row->path, &mf)) row->error = row->bytes == 0 ? "empty or missing file" : "could not open file";
+    else {
+        row->codec = stl_detect_codec(mf.data, mf.size);
+        ok = row->codec == STL_CODEC_NONE ? stats_scan_mapped(&s, mf.data, mf.size) : stats_scan_compressed(&s, mf.data, mf.size);
+        unmap_file(&mf);
+    }
+    if (ok && row->faces == 0) { ok = false; row->error = "no facets found"; }
+    if (row->truncated) app_log(true, "WARN", "'%s': binary STL header claims more facets than the file holds; counted the %lld present.", row->path, row->faces);
+    row->ok = ok;
+    row->degenerate_faces = row->faces - s.sums.valid_faces;
+    row->surface_area = s.sums.area2 * 0.5; row->volume = s.sums.volume6 / 6.0;
+    free_vertex_positions(&s.batch); free(s.chunk.vertices); free(s.chunk.warnings);
+    row->seconds = al_get_time() - start;
+    if (!ok) app_log(true, "WARN", "Stats: '%s': %s.", row->path, row->error);
+}
+
+static void csv_write_field(FILE* out, const char* s) {
+    if (!strpbrk(s, ",\"\r\n")) { fputs(s, out); return; }
+    fputc('"', out);
+    for (const char* p = s; *p; ++p) { if (*p == '"') fputc('"', out); fputc(*p, out); }
+    fputc('"', out);
+}
+
+// Non-finite values (a float overflow in a huge model) become null in JSON and an empty CSV field.
+static void stats_write_number(FILE* out, StatsFormat format, double v) {
+    if (isfinite(v)) fprintf(out, "%.9g", v);
+    else if (format == STATS_FORMAT_JSON) fputs("null", out);
+}
+
+static const char* const k_stats_csv_header = "path,status,error,format,compression,bytes,faces,degenerate_faces,truncated,"
+    "min_x,min_y,min_z,max_x,max_y,max_z,surface_area,volume,seconds\n";
+
+static void stats_write_row(FILE* out, StatsFormat format, const StatsRow* r) {
+    bool bounded = r->ok && r->min_coord.x <= r->max_coord.x;
+    const double bounds[6] = { r->min_coord.x, r->min_coord.y, r->min_coord.z, r->max_coord.x, r->max_coord.y, r->max_coord.z };
+    if (format == STATS_FORMAT_CSV) {
+        csv_write_field(out, r->path);
+        fprintf(out, ",%s,", r->ok ? "ok" : "error");
+        if (!r->ok) csv_write_field(out, r->error);
+        fprintf(out, ",%s,%s,%llu,", r->ok ? (r->binary ? "binary" : "ascii") : "", r->ok ? k_stl_codec_names[r->codec] : "", (unsigned long long)r->bytes);
+        if (r->ok) fprintf(out, "%lld,%lld,%s", r->faces, r->degenerate_faces, r->truncated ? "true" : "false");
+        else fputs(",,", out);
+        for (int k = 0; k < 6; ++k) { fputc(',', out); if (bounded) stats_write_number(out, format, bounds[k]); }
+        fputc(',', out); if (r->ok) stats_write_number(out, format, r->surface_area);
+        fputc(',', out); if (r->ok) stats_write_number(out, format, r->volume);
+        fprintf(out, ",%.4f\n", r->seconds);
+        return;
+    }
+    fputs("{\"path\": ", out); json_write_string(out, r->path);
+    fprintf(out, ", \"status\": \"%s\", \"bytes\": %llu", r->ok ? "ok" : "error", (unsigned long long)r->bytes);
+    if (!r->ok) { fputs(", \"error\": ", out); json_write_string(out, r->error); }
+    else {
+        fprintf(out, ", \"format\": \"%s\", \"compression\": \"%s\", \"faces\": %lld, \"degenerate_faces\": %lld, \"truncated\": %s",
+            r->binary ? "binary" : "ascii", k_stl_codec_names[r->codec], r->faces, r->degenerate_faces, r->truncated ? "true" : "false");
+        if (!bounded) fputs(", \"min\": null, \"max\": null", out);
+        else for (int k = 0; k < 6; ++k) { fputs(k == 0 ? ", \"min\": [" : k == 3 ? "], \"max\": [" : ", ", out); stats_write_number(out, format, bounds[k]); }
+        fputs(bounded ? "], \"surface_area\": " : ", \"surface_area\": ", out); stats_write_number(out, format, r->surface_area);
+        fputs(", \"volume\": ", out); stats_write_number(out, format, r->volume);
+    }
+    fprintf(out, ", \"seconds\": %.4f}\n", r->seconds);
+}
+
+typedef struct {
+    char** paths;
+    int count, capacity;
+} StatsInputs;
+
+static void stats_add_path(StatsInputs* in, const char* path) {
+    if (in->count == in->capacity) {
+        int capacity = in->capacity ? in->capacity * 2 : 256;
+        char** grown = (char**)realloc(in->paths, (size_t)capacity * sizeof(char*));
+        if (!grown) { app_log(true, "ERROR", "Out of memory listing inputs; skipping '%s'.", path); return; }
+        in->paths = grown; in->capacity = capacity;
+    }
+    size_t length = strlen(path) + 1;
+    char* copy = (char*)malloc(length);
+    if (!copy) { app_log(true, "ERROR", "Out of memory listing inputs; skipping '%s'.", path); return; }
+    in->paths[in->count++] = (char*)memcpy(copy, path, length);
+}
+
+static bool stats_name_has_suffix(const char* name, const char* suffix) {
+    size_t n = strlen(name), m = strlen(suffix);
+    if (n < m) return false;
+    for (size_t i = 0; i < m; ++i) {
+        char c = name[n - m + i];
+        if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != suffix[i]) return false;
+    }
+    return true;
+}
+
+static bool stats_is_stl_name(const char* name) {
+    return stats_name_has_suffix(name, ".stl") || stats_name_has_suffix(name, ".stl.gz") || stats_name_has_suffix(name, ".stl.zst");
+}
+
+static int compare_strings(const void* a, const void* b) { return strcmp(*(char* const*)a, *(char* const*)b); }
+
+static void stats_add_directory(StatsInputs* in, ALLEGRO_FS_ENTRY* dir, int depth) {
+    if (depth > STATS_MAX_DIRECTORY_DEPTH) { app_log(true, "WARN", "Not descending into '%s': nested too deep.", al_get_fs_entry_name(dir)); return; }
+    if (!al_open_directory(dir)) { app_log(true, "WARN", "Could not read directory '%s'.", al_get_fs_entry_name(dir)); return; }
+    for (ALLEGRO_FS_ENTRY* entry; (entry = al_read_directory(dir)) != NULL; al_destroy_fs_entry(entry)) {
+        if (al_get_fs_entry_mode(entry) & ALLEGRO_FILEMODE_ISDIR) stats_add_directory(in, entry, depth + 1);
+        else if (stats_is_stl_name(al_get_fs_entry_name(entry))) stats_add_path(in, al_get_fs_entry_name(entry));
+    }
+    al_close_directory(dir);
+}
+
+// A directory contributes its STL files sorted by path, so the row order does not depend on the file system.
+static void stats_add_file_or_directory(StatsInputs* in, const char* path) {
+    ALLEGRO_FS_ENTRY* entry = al_create_fs_entry(path);
+    if (entry && (al_get_fs_entry_mode(entry) & ALLEGRO_FILEMODE_ISDIR)) {
+        int first = in->count;
+        stats_add_directory(in, entry, 0);
+        qsort(in->paths + first, (size_t)(in->count - first), sizeof(char*), compare_strings);
+    }
+    else stats_add_path(in, path); // Missing files still get a row, reporting the error
+    if (entry) al_destroy_fs_entry(entry);
+}
+
+static void stats_add_input(StatsInputs* in, const char* arg) {
+    if (arg[0] != '@') { stats_add_file_or_directory(in, arg); return; }
+    FILE* list = fopen(arg + 1, "r");
+    if (!list) { app_log(true, "ERROR", "Could not open file list '%s'.", arg + 1); return; }
+    char line[4096];
+    while (fgets(line, sizeof(line), list)) {
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || is_stl_space(line[length - 1]))) line[--length] = '\0';
+        if (length > 0 && line[0] != '#') stats_add_file_or_directory(in, line);
+    }
+    fclose(list);
+}
+
+typedef struct {
+    uint64_t bytes;
+    int row;
+} StatsJob;
+
+static int compare_stats_jobs(const void* a, const void* b) {
+    const StatsJob* ja = (const StatsJob*)a; const StatsJob* jb = (const StatsJob*)b;
+    if (ja->bytes != jb->bytes) return ja->bytes < jb->bytes ? 1 : -1; // Largest first
+    return ja->row - jb->row;
+}
+
+typedef struct {
+    StatsRow* rows;
+    const StatsJob* jobs;
+    int count;
+    FILE* out;
+    StatsFormat format;
+    ALLEGRO_MUTEX* mutex; // Guards done, next_row and out
+    int next_row;         // Rows before it have been written
+} StatsRun;
+
+// Scans one file, then writes every finished row that is next in input order.
+static void stats_file_job(void* context, int job_index) {
+    StatsRun* run = (StatsRun*)context;
+    StatsRow* row = &run->rows[run->jobs[job_index].row];
+    stats_scan_file(row);
+    al_lock_mutex(run->mutex);
+    row->done = true;
+    int first = run->next_row;
+    while (run->next_row < run->count && run->rows[run->next_row].done) stats_write_row(run->out, run->format, &run->rows[run->next_row++]);
+    if (run->next_row > first) fflush(run->out);
+    al_unlock_mutex(run->mutex);
+}
+
+// Runs the whole audit. Returns the process exit code: 1 if any file could not be read, though every file still
+// gets its row.
+static int run_stats(int argc, char** argv, const StatsOptions* options) {
+    if (!al_init()) { app_log(true, "ERROR", "Failed to initialize Allegro for --stats."); return 1; }
+    log_start_writer();
+    worker_pool_init();
+    select_facet_sums_kernel(options->allow_simd);
+    StatsInputs inputs = { NULL, 0, 0 };
+    for (int i = 1; i < argc; ++i) { if (strncmp(argv[i], "--", 2) != 0) stats_add_input(&inputs, argv[i]); }
+    if (inputs.count == 0) { app_log(true, "ERROR", "--stats needs at least one STL file, directory or @list."); free(inputs.paths); return 1; }
+
+    StatsRow* rows = (StatsRow*)calloc((size_t)inputs.count, sizeof(StatsRow));
+    StatsJob* jobs = (StatsJob*)malloc((size_t)inputs.count * sizeof(StatsJob));
+    StatsRun run; memset(&run, 0, sizeof(run));
+    run.mutex = al_create_mutex();
+    run.out = options->out_path ? fopen(options->out_path, "w") : stdout;
+    int exit_code = 1;
+    if (!rows || !jobs || !run.mutex) app_log(true, "ERROR", "--stats aborted: out of memory for %d files.", inputs.count);
+    else if (!run.out) app_log(true, "ERROR", "--stats aborted: could not open %s.", options->out_path);
+    else {
+        uint64_t total_bytes = 0; int64_t mtime;
+        for (int i = 0; i < inputs.count; ++i) {
+            rows[i].path = inputs.paths[i];
+            if (!stat_source_file(rows[i].path, &rows[i].bytes, &mtime)) rows[i].bytes = 0;
+            jobs[i].bytes = rows[i].bytes; jobs[i].row = i;
+            total_bytes += rows[i].bytes;
+        }
+        qsort(jobs, (size_t)inputs.count, sizeof(StatsJob), compare_stats_jobs);
+        run.rows = rows; run.jobs = jobs; run.count = inputs.count; run.format = options->format;
+        app_log(true, "INFO", "Stats: %d files, %.1f MB, %d threads, %s kernel.", inputs.count, total_bytes / (1024.0 * 1024.0), worker_pool_size(), g_facet_sums_kernel_name);
+        if (options->format == STATS_FORMAT_CSV) fputs(k_stats_csv_header, run.out);
+        double start = al_get_time();
+        parallel_for(inputs.count, stats_file_job, &run);
+        double seconds = al_get_time() - start;
+        int failed = 0;
+        for (int i = 0; i < inputs.count; ++i) { if (!rows[i].ok) failed++; }
+        app_log(true, "INFO", "Stats: %d files (%d failed) in %.2f s, %.1f MB/s, %.0f files/s.", inputs.count, failed, seconds,
+            seconds > 0.0 ? total_bytes / (1024.0 * 1024.0) / seconds : 0.0, seconds > 0.0 ? inputs.count / seconds : 0.0);
+        exit_code = failed > 0 || ferror(run.out) ? 1 : 0;
+    }
+    if (run.out && run.out != stdout) fclose(run.out);
+    if (run.mutex) al_destroy_mutex(run.mutex);
+    for (int i = 0; i < inputs.count; ++i) free(inputs.paths[i]);
+    free(inputs.paths); free(rows); free(jobs);
+    worker_pool_shutdown();
+    return exit_code;
+}
+
+// --- Mesh Validation ---
+// 'V' checks the loaded mesh and overlays what it found. Corners are matched by their WELD_GRID_STEPS cell (exactly
+// the corners --weld would merge), packed into a 63-bit key, so the check works the same on welded and unwelded
+// meshes. Every face emits its three undirected edges as records keyed by their two corner keys; records are hashed
+// into VALIDATE_PARTITIONS partitions, and each partition is grouped with its own hash table as one worker pool job.
+// An edge used once is open (a boundary), more than twice non-manifold, and twice in the same direction inconsistently
+// wound. A second pass keys whole faces by their sorted corner keys to find duplicates. When the records would
+// exceed VALIDATE_RECORD_BUDGET the faces are scanned again for each slice of the partitions, which bounds memory.
+#define VALIDATE_BLOCK_FACES 65536
+#define VALIDATE_PARTITIONS 256
+#define VALIDATE_RECORD_BUDGET ((size_t)256 << 20) // Bytes of edge or face records held at once
+#define VALIDATE_KEY_BITS 21                         // Per axis; |cell| < 2^20 covers MODEL_VIEW_SIZE with room to spare
+#define VALIDATE_NO_KEY UINT64_MAX                   // Non-finite corner
+
+typedef struct {
+    uint64_t key[3]; // Edge: lower and higher corner key, 0. Face: its corner keys, sorted
+    int item;        // Half-edge (face * 3 + corner) or face
+    int forward;     // Edge: 1 if the face runs it from key[0] to key[1]
+} ValidateRecord;
+
+typedef struct {
+    long long groups, open, non_manifold, winding, duplicates;
+    bool out_of_memory;
+} ValidatePartition;
+
+typedef struct {
+    uint64_t* keys;       // Per vertex
+    uint8_t* edge_flags;  // Per half-edge
+    bool faces_pass;
+    int block_count, round, rounds;
+    int* offsets;         // [block][VALIDATE_PARTITIONS]: record counts, then write positions
+    int part_start[VALIDATE_PARTITIONS + 1];
+    ValidateRecord* records;
+    ValidatePartition parts[VALIDATE_PARTITIONS];
+} ValidateJob;
+
+typedef struct {
+    long long edges, open_edges, non_manifold_edges, winding_edges, duplicate_faces, degenerate_faces;
+    double seconds;
+} MeshValidationReport;
+
+MeshValidationReport g_validation;
+
+static uint64_t validate_vertex_key(Point3D p) {
+    if (!isfinite(p.x) || !isfinite(p.y) || !isfinite(p.z)) return VALIDATE_NO_KEY;
+    const float inv_step = (float)WELD_GRID_STEPS / MODEL_VIEW_SIZE;
+    const float c[3] = { p.x, p.y, p.z };
+    const int64_t bias = (int64_t)1 << (VALIDATE_KEY_BITS - 1);
+    uint64_t key = 0;
+    for (int k = 0; k < 3; ++k) {
+        int64_t q = (int64_t)floorf(fminf(fmaxf(c[k] * inv_step + 0.5f, (float)-bias), (float)(bias - 1)));
+        key |= (uint64_t)(q + bias) << (k * VALIDATE_KEY_BITS);
+    }
+    return key;
+}
+
+static uint64_t validate_mix(uint64_t h) { // splitmix64 finalizer
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL; h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL; h ^= h >> 33;
+    return h;
+}
+
+static uint64_t validate_record_hash(const ValidateRecord* r) { return validate_mix(r->key[0] ^ validate_mix(r->key[1] ^ validate_mix(r->key[2]))); }
+
+static bool validate_same_key(const ValidateRecord* a, const ValidateRecord* b) { return a->key[0] == b->key[0] && a->key[1] == b->key[1] && a->key[2] == b->key[2]; }
+
+static void validate_keys_job(void* context, int block) {
+    ValidateJob* job = (ValidateJob*)context;
+    int end = (block + 1) * VALIDATE_BLOCK_FACES < num_vertices ? (block + 1) * VALIDATE_BLOCK_FACES : num_vertices;
+    for (int i = block * VALIDATE_BLOCK_FACES; i < end; ++i) job->keys[i] = validate_vertex_key(model_vertex(i));
+}
+
+// Marks degenerate faces in g_face_issues, and the ones whose corners collapse or are invalid as skipped.
+static void validate_faces_job(void* context, int block) {
+    ValidateJob* job = (ValidateJob*)context;
+    const float eps2 = STATS_DEGENERATE_SINE * STATS_DEGENERATE_SINE;
+    int end = (block + 1) * VALIDATE_BLOCK_FACES < num_faces ? (block + 1) * VALIDATE_BLOCK_FACES : num_faces;
+    for (int f = block * VALIDATE_BLOCK_FACES; f < end; ++f) {
+        const int* v = faces[f].v_idx;
+        uint8_t flags = 0;
+        if (!face_corners_valid(&faces[f], num_vertices)) flags = VALIDATE_DEGENERATE | VALIDATE_SKIP;
+        else {
+            uint64_t k0 = job->keys[v[0]], k1 = job->keys[v[1]], k2 = job->keys[v[2]];
+            if (k0 == k1 || k1 == k2 || k0 == k2 || k0 == VALIDATE_NO_KEY || k1 == VALIDATE_NO_KEY || k2 == VALIDATE_NO_KEY) flags = VALIDATE_DEGENERATE | VALIDATE_SKIP;
+            else {
+                Point3D p0 = model_vertex(v[0]), e1 = vec_subtract(model_vertex(v[1]), p0), e2 = vec_subtract(model_vertex(v[2]), p0);
+                Point3D n = vec_cross_product(e1, e2);
+                if (!(vec_dot_product(n, n) > eps2 * vec_dot_product(e1, e1) * vec_dot_product(e2, e2))) flags = VALIDATE_DEGENERATE;
+            }
+        }
+        g_face_issues[f] = flags;
+    }
+}
+
+// Records of face f for the current pass: its three edges, or the face itself. None for skipped faces.
+static int validate_face_records(const ValidateJob* job, int f, ValidateRecord out[3]) {
+    if (g_face_issues[f] & VALIDATE_SKIP) return 0;
+    const int* v = faces[f].v_idx;
+    uint64_t k[3] = { job->keys[v[0]], job->keys[v[1]], job->keys[v[2]] };
+    if (job->faces_pass) {
+        uint64_t t;
+        if (k[0] > k[1]) { t = k[0]; k[0] = k[1]; k[1] = t; }
+        if (k[1] > k[2]) { t = k[1]; k[1] = k[2]; k[2] = t; }
+        if (k[0] > k[1]) { t = k[0]; k[0] = k[1]; k[1] = t; }
+        out[0] = (ValidateRecord){ { k[0], k[1], k[2] }, f, 0 };
+        return 1;
+    }
+    for (int c = 0; c < 3; ++c) {
+        uint64_t a = k[c], b = k[(c + 1) % 3];
+        out[c] = (ValidateRecord){ { a < b ? a : b, a < b ? b : a, 0 }, f * 3 + c, a < b };
+    }
+    return 3;
+}
+
+// Partition of a record within the current round, or -1 if another round handles it.
+static int validate_record_partition(const ValidateJob* job, const ValidateRecord* r) {
+    int part = (int)((validate_record_hash(r) >> 32) % (uint64_t)(job->rounds * VALIDATE_PARTITIONS));
+    return part / VALIDATE_PARTITIONS == job->round ? part % VALIDATE_PARTITIONS : -1;
+}
+
+static void validate_count_job(void* context, int block) {
+    ValidateJob* job = (ValidateJob*)context;
+    int* counts = job->offsets + (size_t)block * VALIDATE_PARTITIONS;
+    memset(counts, 0, VALIDATE_PARTITIONS * sizeof(int));
+    int end = (block + 1) * VALIDATE_BLOCK_FACES < num_faces ? (block + 1) * VALIDATE_BLOCK_FACES : num_faces;
+    ValidateRecord r[3];
+    for (int f = block * VALIDATE_BLOCK_FACES; f < end; ++f) {
+        int n = validate_face_records(job, f, r);
+        for (int i = 0; i < n; ++i) { int part = validate_record_partition(job, &r[i]); if (part >= 0) counts[part]++; }
+    }
+}
+
+static void validate_scatter_job(void* context, int block) {
+    ValidateJob* job = (ValidateJob*)context;
+    int* next = job->offsets + (size_t)block * VALIDATE_PARTITIONS;
+    int end = (block + 1) * VALIDATE_BLOCK_FACES < num_faces ? (block + 1) * VALIDATE_BLOCK_FACES : num_faces;
+    ValidateRecord r[3];
+    for (int f = block * VALIDATE_BLOCK_FACES; f < end; ++f) {
+        int n = validate_face_records(job, f, r);
+        for (int i = 0; i < n; ++i) { int part = validate_record_partition(job, &r[i]); if (part >= 0) job->records[next[part]++] = r[i]; }
+    }
+}
+
+// Groups one partition's records by key and flags their half-edges (edge pass) or faces (face pass). Every record
+// belongs to exactly one partition, so no two jobs write the same flag byte.
+static void validate_analyze_job(void* context, int part) {
+    ValidateJob* job = (ValidateJob*)context;
+    ValidatePartition* out = &job->parts[part];
+    const ValidateRecord* r = job->records + job->part_start[part];
+    int n = job->part_start[part + 1] - job->part_start[part];
+    if (n == 0) return;
+    size_t table_size = 16; while (table_size < (size_t)n * 2) table_size <<= 1;
+    int* table = (int*)malloc(table_size * sizeof(int));
+    int* group = (int*)malloc((size_t)n * sizeof(int));
+    int* uses = (int*)calloc((size_t)n * 2, sizeof(int)); // uses[i * 2]: records in group i, uses[i * 2 + 1]: forward ones
+    if (!table || !group || !uses) { out->out_of_memory = true; free(table); free(group); free(uses); return; }
+    memset(table, 0xFF, table_size * sizeof(int)); // -1 marks an empty slot
+    for (int i = 0; i < n; ++i) {
+        size_t slot = (size_t)validate_record_hash(&r[i]) & (table_size - 1);
+        while (table[slot] >= 0 && !validate_same_key(&r[table[slot]], &r[i])) slot = (slot + 1) & (table_size - 1);
+        if (table[slot] < 0) table[slot] = i;
+        group[i] = table[slot];
+        uses[group[i] * 2]++; uses[group[i] * 2 + 1] += r[i].forward;
+    }
+    for (int i = 0; i < n; ++i) {
+        int count = uses[group[i] * 2], forward = uses[group[i] * 2 + 1];
+        bool first = group[i] == i;
+        if (job->faces_pass) {
+            if (count > 1) { g_face_issues[r[i].item] |= VALIDATE_DUPLICATE; if (!first) out->duplicates++; }
+            continue;
+        }
+        uint8_t flags = count == 1 ? VALIDATE_OPEN_EDGE : count > 2 ? VALIDATE_NON_MANIFOLD : forward != 1 ? VALIDATE_WINDING : 0;
+        if (first) {
+            out->groups++;
+            if (flags == VALIDATE_OPEN_EDGE) out->open++;
+            else if (flags == VALIDATE_NON_MANIFOLD) out->non_manifold++;
+            else if (flags == VALIDATE_WINDING) out->winding++;
+            if (flags & (VALIDATE_OPEN_EDGE | VALIDATE_NON_MANIFOLD)) flags |= VALIDATE_DRAW_EDGE;
+        }
+        job->edge_flags[r[i].item] = flags;
+    }
+    free(table); free(group); free(uses);
+}
+
+// Runs the edge or face pass over record_count records in as many rounds as VALIDATE_RECORD_BUDGET requires.
+static bool validate_run_pass(ValidateJob* job, bool faces_pass, long long record_count) {
+    job->faces_pass = faces_pass;
+    job->rounds = (int)((unsigned long long)record_count * sizeof(ValidateRecord) / VALIDATE_RECORD_BUDGET) + 1;
+    memset(job->parts, 0, sizeof(job->parts));
+    int capacity = 0; bool ok = true;
+    for (job->round = 0; ok && job->round < job->rounds; ++job->round) {
+        parallel_for(job->block_count, validate_count_job, job);
+        long long total = 0;
+        for (int p = 0; p < VALIDATE_PARTITIONS; ++p) {
+            job->part_start[p] = (int)total;
+            for (int b = 0; b < job->block_count; ++b) {
+                int* slot = &job->offsets[(size_t)b * VALIDATE_PARTITIONS + p];
+                int count = *slot; *slot = (int)total; total += count;
+            }
+        }
+        job->part_start[VALIDATE_PARTITIONS] = (int)total;
+        if (total > capacity) {
+            ValidateRecord* grown = total <= INT_MAX ? (ValidateRecord*)realloc(job->records, (size_t)total * sizeof(ValidateRecord)) : NULL;
+            if (!grown) { ok = false; break; }
+            job->records = grown; capacity = (int)total;
+        }
+        parallel_for(job->block_count, validate_scatter_job, job);
+        parallel_for(VALIDATE_PARTITIONS, validate_analyze_job, job);
+        for (int p = 0; p < VALIDATE_PARTITIONS; ++p) { if (job->parts[p].out_of_memory) ok = false; }
+    }
+    free(job->records); job->records = NULL;
+    return ok;
+}
+
+
+// Validates the loaded model and fills g_validation, g_face_issues and the overlay lists. Returns false when memory ran out.
+static bool validate_mesh(void) {
+    free_mesh_validation_data();
+    memset(&g_validation, 0, sizeof(g_validation));
+    if (num_faces == 0) return false;
+    double start_time = al_get_time();
+    ValidateJob* job = (ValidateJob*)calloc(1, sizeof(ValidateJob));
+    uint64_t* keys = (uint64_t*)malloc((size_t)num_vertices * sizeof(uint64_t));
+    uint8_t* edge_flags = (uint8_t*)calloc((size_t)num_faces * 3, 1);
+    g_face_issues = (uint8_t*)calloc((size_t)num_faces, 1);
+    int block_count = (num_faces + VALIDATE_BLOCK_FACES - 1) / VALIDATE_BLOCK_FACES;
+    int* offsets = (int*)malloc((size_t)block_count * VALIDATE_PARTITIONS * sizeof(int));
+    bool ok = job && keys && edge_flags && g_face_issues && offsets;
+    if (ok) {
+        job->keys = keys; job->edge_flags = edge_flags; job->offsets = offsets; job->block_count = block_count;
+        parallel_for((num_vertices + VALIDATE_BLOCK_FACES - 1) / VALIDATE_BLOCK_FACES, validate_keys_job, job);
+        parallel_for(block_count, validate_faces_job, job);
+        long long usable_faces = 0;
+        for (int f = 0; f < num_faces; ++f) { if (!(g_face_issues[f] & VALIDATE_SKIP)) usable_faces++; }
+        ok = validate_run_pass(job, false, usable_faces * 3);
+        for (int p = 0; ok && p < VALIDATE_PARTITIONS; ++p) {
+            g_validation.edges += job->parts[p].groups; g_validation.open_edges += job->parts[p].open;
+            g_validation.non_manifold_edges += job->parts[p].non_manifold; g_validation.winding_edges += job->parts[p].winding;
+        }
+        ok = ok && validate_run_pass(job, true, usable_faces);
+        for (int p = 0; ok && p < VALIDATE_PARTITIONS; ++p) g_validation.duplicate_faces += job->parts[p].duplicates;
+    }
+    if (ok) { // Fold the half-edge flags into their faces and list what the overlay draws
+        for (int f = 0; f < num_faces; ++f) {
+            uint8_t flags = g_face_issues[f] & ~VALIDATE_SKIP;
+            for (int c = 0; c < 3; ++c) {
+                flags |= edge_flags[f * 3 + c] & (VALIDATE_OPEN_EDGE | VALIDATE_NON_MANIFOLD | VALIDATE_WINDING);
+                if (edge_flags[f * 3 + c] & VALIDATE_DRAW_EDGE) g_num_issue_edges++;
+            }
+            g_face_issues[f] = flags;
+            if (flags & VALIDATE_DEGENERATE) g_validation.degenerate_faces++;
+            if (flags) g_num_issue_faces++;
+        }
+        g_issue_faces = (int*)malloc((size_t)(g_num_issue_faces > 0 ? g_num_issue_faces : 1) * sizeof(int));
+        g_issue_edges = (int*)malloc((size_t)(g_num_issue_edges > 0 ? g_num_issue_edges : 1) * sizeof(int));
+        ok = g_issue_faces && g_issue_edges;
+        for (int f = 0, nf = 0, ne = 0; ok && f < num_faces; ++f) {
+            if (g_face_issues[f]) g_issue_faces[nf++] = f;
+            for (int c = 0; c < 3; ++c) { // Non-manifold edges are stored complemented
+                uint8_t e = edge_flags[f * 3 + c];
+                if (e & VALIDATE_DRAW_EDGE) g_issue_edges[ne++] = (e & VALIDATE_NON_MANIFOLD) ? ~(f * 3 + c) : f * 3 + c;
+            }
+        }
+    }
+    free(keys); free(edge_flags); free(offsets); free(job);
+    if (!ok) { app_log(true, "ERROR", "Not enough memory to validate %d faces.", num_faces); free_mesh_validation_data(); return false; }
+    g_mesh_validated = true;
+    g_validation.seconds = al_get_time() - start_time;
+    const MeshValidationReport* v = &g_validation;
+    app_log(true, "INFO", "Validation: %d faces, %lld edges: %lld open, %lld non-manifold, %lld inconsistently wound; %lld duplicate and %lld degenerate faces (%.3f s).",
+        num_faces, v->edges, v->open_edges, v->non_manifold_edges, v->winding_edges, v->duplicate_faces, v->degenerate_faces, v->seconds);
+    return true;
+}
+
+static ALLEGRO_COLOR validation_face_color(uint8_t flags) { // Premultiplied, most serious issue first
+    if (flags & VALIDATE_NON_MANIFOLD) return al_map_rgba_f(0.35f, 0.0f, 0.35f, 0.35f);
+    if (flags & VALIDATE_DUPLICATE) return al_map_rgba_f(0.0f, 0.35f, 0.35f, 0.35f);
+    if (flags & VALIDATE_WINDING) return al_map_rgba_f(0.35f, 0.18f, 0.0f, 0.35f);
+    if (flags & VALIDATE_DEGENERATE) return al_map_rgba_f(0.35f, 0.35f, 0.0f, 0.35f);
+    return al_map_rgba_f(0.2f, 0.0f, 0.0f, 0.2f); // Only next to an open edge
+}
+
+// Tints every flagged face and draws open (red) and non-manifold (magenta) edges on top of the frame, hidden or not,
+// so problems on the far side show through. Projects the corners itself: the frame only transformed visible meshlets.
+static void draw_validation_overlay(const ViewTransform* view) {
+    if (!g_show_validation || !g_mesh_validated) return;
+    ALLEGRO_VERTEX* tri = triangle_batch_begin(g_num_issue_faces * 3, num_faces);
+    if (tri) {
+        for (int i = 0; i < g_num_issue_faces; ++i) {
+            int f = g_issue_faces[i];
+            ALLEGRO_COLOR color = validation_face_color(g_face_issues[f]);
+            for (int k = 0; k < 3; ++k) {
+                Point3D p = view_project(view, model_vertex(faces[f].v_idx[k]));
+                tri[i * 3 + k] = (ALLEGRO_VERTEX){ p.x + SCREEN_W / 2.0f, -p.y + SCREEN_H / 2.0f, 0, 0, 0, color };
+            }
+        }
+        triangle_batch_submit(g_num_issue_faces * 3);
+    }
+    ALLEGRO_VERTEX* lines = g_num_issue_edges > 0 ? (ALLEGRO_VERTEX*)malloc((size_t)g_num_issue_edges * 2 * sizeof(ALLEGRO_VERTEX)) : NULL;
+    if (!lines) return;
+    for (int i = 0; i < g_num_issue_edges; ++i) {
+        bool non_manifold = g_issue_edges[i] < 0;
+        int half_edge = non_manifold ? ~g_issue_edges[i] : g_issue_edges[i], f = half_edge / 3, c = half_edge % 3;
+        ALLEGRO_COLOR color = non_manifold ? al_map_rgb(255, 0, 255) : al_map_rgb(255, 40, 40);
+        for (int k = 0; k < 2; ++k) {
+            Point3D p = view_project(view, model_vertex(faces[f].v_idx[(c + k) % 3]));
+            lines[i * 2 + k] = (ALLEGRO_VERTEX){ p.x + SCREEN_W / 2.0f, -p.y + SCREEN_H / 2.0f, 0, 0, 0, color };
+        }
+    }
+    draw_line_list(lines, g_num_issue_edges * 2);
+    free(lines);
+}
+
+// --- Cross-Section Slicing ---
+// 'S' cuts the model with the plane z = g_slice_z (object space) and PgUp/PgDn move it through the model. Face Z
+// extents go into a centered interval tree once, so moving the plane only visits the faces that straddle it plus one
+// path from the root. The cut segments are joined where they cross the same edge, matched like validate_mesh() by the
+// corner keys of that edge, into polylines: closed loops where the surface is watertight, open ones at holes.
+#define SLICE_STEPS 256 // PgUp/PgDn steps across the model's Z range
+
+typedef struct {
+    uint64_t key[2]; // Corner keys of the crossed edge, lower first
+    Point3D point;
+    int link[2];     // Neighboring joints along the cut, or -1
+} SliceJoint;
+
+static int compare_slice_mid(const void* a, const void* b) {
+    float ma = ((const SliceInterval*)a)->zmin + ((const SliceInterval*)a)->zmax, mb = ((const SliceInterval*)b)->zmin + ((const SliceInterval*)b)->zmax;
+    return (ma > mb) - (ma < mb);
+}
+static int compare_slice_min(const void* a, const void* b) { float x = ((const SliceInterval*)a)->zmin, y = ((const SliceInterval*)b)->zmin; return (x > y) - (x < y); }
+static int compare_slice_max(const void* a, const void* b) { float x = ((const SliceInterval*)a)->zmax, y = ((const SliceInterval*)b)->zmax; return (x < y) - (x > y); }
+
+// Builds the subtree over items (sorted by midpoint) around the median midpoint, which always stays in the node, so
+// each child gets at most half of the items. Reorders items; scratch must hold count entries. The node lists are
+// sorted afterwards by slice_sort_node_job().
+static int slice_build_node(SliceInterval* items, int count, SliceInterval* scratch, int* next_node, int* next_first) {
+    if (count == 0) return -1;
+    float center = 0.5f * (items[count / 2].zmin + items[count / 2].zmax);
+    int first = *next_first, below = 0, here = 0, above = 0;
+    for (int i = 0; i < count; ++i) {
+        if (items[i].zmax < center) items[below++] = items[i];
+        else if (items[i].zmin > center) scratch[above++] = items[i];
+        else g_slice_by_min[first + here++] = items[i];
+    }
+    memcpy(items + below, scratch, (size_t)above * sizeof(SliceInterval));
+    memcpy(g_slice_by_max + first, g_slice_by_min + first, (size_t)here * sizeof(SliceInterval));
+    *next_first += here;
+    int node = (*next_node)++;
+    g_slice_nodes[node] = (SliceNode){ center, -1, -1, first, here };
+    int left = slice_build_node(items, below, scratch, next_node, next_first);
+    int right = slice_build_node(items + below, above, scratch, next_node, next_first);
+    g_slice_nodes[node].left = left; g_slice_nodes[node].right = right;
+    return node;
+}
+
+static void slice_sort_node_job(void* context, int node) {
+    (void)context;
+    const SliceNode* n = &g_slice_nodes[node];
+    qsort(g_slice_by_min + n->first, n->count, sizeof(SliceInterval), compare_slice_min);
+    qsort(g_slice_by_max + n->first, n->count, sizeof(SliceInterval), compare_slice_max);
+}
+
+static bool build_slice_index(void) {
+    double start_time = al_get_time();
+    SliceInterval* items = (SliceInterval*)malloc((size_t)(num_faces > 0 ? num_faces : 1) * sizeof(SliceInterval));
+    SliceInterval* scratch = (SliceInterval*)malloc((size_t)(num_faces > 0 ? num_faces : 1) * sizeof(SliceInterval));
+    g_slice_by_min = (SliceInterval*)malloc((size_t)(num_faces > 0 ? num_faces : 1) * sizeof(SliceInterval));
+    g_slice_by_max = (SliceInterval*)malloc((size_t)(num_faces > 0 ? num_faces : 1) * sizeof(SliceInterval));
+    g_slice_nodes = (SliceNode*)malloc((size_t)(num_faces > 0 ? num_faces : 1) * sizeof(SliceNode));
+    if (!items || !scratch || !g_slice_by_min || !g_slice_by_max || !g_slice_nodes) {
+        app_log(true, "ERROR", "Not enough memory to index %d faces for slicing.", num_faces);
+        free(items); free(scratch); free_slice_data(); return false;
+    }
+    int count = 0;
+    g_slice_zmin = FLT_MAX; g_slice_zmax = -FLT_MAX;
+    for (int f = 0; f < num_faces; ++f) {
+        if (!face_corners_valid(&faces[f], num_vertices)) continue;
+        float z0 = model_vertex(faces[f].v_idx[0]).z, z1 = model_vertex(faces[f].v_idx[1]).z, z2 = model_vertex(faces[f].v_idx[2]).z;
+        if (!isfinite(z0) || !isfinite(z1) || !isfinite(z2)) continue;
+        items[count] = (SliceInterval){ fminf(z0, fminf(z1, z2)), fmaxf(z0, fmaxf(z1, z2)), f };
+        g_slice_zmin = fminf(g_slice_zmin, items[count].zmin); g_slice_zmax = fmaxf(g_slice_zmax, items[count].zmax);
+        count++;
+    }
+    if (count > 0 && ensure_depth_key_capacity(count)) { // Radix sort by midpoint with the painter's buffers; descending depth of -mid is ascending mid
+        for (int i = 0; i < count; ++i) depth_keys[i] = (DepthKey){ depth_sort_key(-0.5f * (items[i].zmin + items[i].zmax)), i };
+        radix_sort_depth_keys(count);
+        for (int i = 0; i < count; ++i) scratch[i] = items[depth_keys[i].face];
+        memcpy(items, scratch, (size_t)count * sizeof(SliceInterval));
+    }
+    else qsort(items, count, sizeof(SliceInterval), compare_slice_mid);
+    int node_count = 0, first = 0;
+    g_slice_root = slice_build_node(items, count, scratch, &node_count, &first);
+    parallel_for(node_count, slice_sort_node_job, NULL);
+    free(items); free(scratch);
+    if (count == 0) { g_slice_zmin = g_slice_zmax = 0.0f; }
+    app_log(true, "INFO", "Indexed %d faces for slicing: %d interval tree nodes (%.3f s).", count, node_count, al_get_time() - start_time);
+    return true;
+}
+
+// Joint for the edge key, added to the table (size a power of two) if it is new.
+static int slice_joint(SliceJoint* joints, int* joint_count, int* table, size_t table_size, const uint64_t key[2], Point3D point) {
+    size_t slot = (size_t)validate_mix(key[0] ^ validate_mix(key[1])) & (table_size - 1);
+    while (table[slot] >= 0 && (joints[table[slot]].key[0] != key[0] || joints[table[slot]].key[1] != key[1])) slot = (slot + 1) & (table_size - 1);
+    if (table[slot] < 0) {
+        table[slot] = (*joint_count)++;
+        joints[table[slot]] = (SliceJoint){ { key[0], key[1] }, point, { -1, -1 } };
+    }
+    return table[slot];
+}
+
+static void slice_link(SliceJoint* joint, int other) {
+    if (joint->link[0] < 0) joint->link[0] = other;
+    else if (joint->link[1] < 0) joint->link[1] = other; // A third link means a non-manifold edge; the cut just branches there
+}
+
+// Appends the polyline that starts at joint start to the outline. Returns its point count.
+static int slice_walk(const SliceJoint* joints, bool* visited, int start, int* point_count) {
+    int first = *point_count, cur = start;
+    g_slice_points[(*point_count)++] = joints[start].point; visited[start] = true;
+    for (;;) {
+        int next = -1;
+        for (int k = 0; k < 2; ++k) { int n = joints[cur].link[k]; if (n >= 0 && !visited[n]) { next = n; break; } }
+        if (next < 0) break;
+        g_slice_points[(*point_count)++] = joints[next].point; visited[next] = true; cur = next;
+    }
+    int length = *point_count - first;
+    if (length > 2 && (joints[cur].link[0] == start || joints[cur].link[1] == start)) { g_slice_points[(*point_count)++] = joints[start].point; g_num_slice_closed++; length++; }
+    if (length < 2) { *point_count = first; return 0; } // Lone joint of a collapsed cut
+    g_slice_polylines[++g_num_slice_polylines] = *point_count;
+    return length;
+}
+
+// Recomputes the outline at g_slice_z.
+static void update_slice(void) {
+    double start_time = al_get_time();
+    free(g_slice_points); free(g_slice_polylines);
+    g_slice_points = NULL; g_slice_polylines = NULL; g_num_slice_polylines = g_num_slice_closed = 0;
+    if (!g_slice_nodes) return;
+    const float z = g_slice_z;
+    int capacity = 1024, segment_count = 0, visited_faces = 0;
+    SliceJoint* ends = (SliceJoint*)malloc((size_t)capacity * 2 * sizeof(SliceJoint)); // Two per segment
+    for (int node = g_slice_root; node >= 0 && ends;) {
+        const SliceNode* n = &g_slice_nodes[node];
+        bool lower = z < n->center; // Only the node's intervals reaching z can straddle it, and they come first
+        for (int i = 0; ends && i < n->count; ++i) {
+            const SliceInterval* it = lower ? &g_slice_by_min[n->first + i] : &g_slice_by_max[n->first + i];
+            if (lower ? it->zmin > z : it->zmax < z) break;
+            visited_faces++;
+            const int* v = faces[it->face].v_idx;
+            Point3D p[3]; uint64_t k[3]; bool up[3];
+            for (int c = 0; c < 3; ++c) { p[c] = model_vertex(v[c]); k[c] = validate_vertex_key(p[c]); up[c] = p[c].z >= z; }
+            if ((up[0] == up[1] && up[1] == up[2]) || k[0] == k[1] || k[1] == k[2] || k[0] == k[2]) continue;
+            if (segment_count == capacity) {
+                SliceJoint* grown = (SliceJoint*)realloc(ends, (size_t)capacity * 4 * sizeof(SliceJoint));
+                if (!grown) { free(ends); ends = NULL; break; }
+                ends = grown; capacity *= 2;
+            }
+            int e = segment_count * 2;
+            for (int c = 0; c < 3; ++c) { // Exactly two edges change sides; interpolate from the lower key so both faces agree
+                int a = c, b = (c + 1) % 3;
+                if (up[a] == up[b]) continue;
+                if (k[a] > k[b]) { a = b; b = c; }
+                float t = (z - p[a].z) / (p[b].z - p[a].z);
+                ends[e++] = (SliceJoint){ { k[a], k[b] }, { p[a].x + t * (p[b].x - p[a].x), p[a].y + t * (p[b].y - p[a].y), z }, { -1, -1 } };
+            }
+            segment_count++;
+        }
+        node = lower ? n->left : n->right;
+    }
+    size_t table_size = 16; while (table_size < (size_t)segment_count * 4) table_size <<= 1;
+    int* table = (int*)malloc(table_size * sizeof(int));
+    SliceJoint* joints = (SliceJoint*)malloc((size_t)(segment_count > 0 ? segment_count : 1) * 2 * sizeof(SliceJoint));
+    bool* visited = (bool*)calloc((size_t)(segment_count > 0 ? segment_count : 1) * 2, sizeof(bool));
+    g_slice_points = (Point3D*)malloc((size_t)(segment_count > 0 ? segment_count : 1) * 3 * sizeof(Point3D)); // Joints plus one closing point per loop
+    g_slice_polylines = (int*)malloc(((size_t)segment_count * 2 + 1) * sizeof(int));
+    if (!ends || !table || !joints || !visited || !g_slice_points || !g_slice_polylines) {
+        app_log(true, "ERROR", "Not enough memory to slice %d faces.", segment_count);
+        free(ends); free(table); free(joints); free(visited); free(g_slice_points); free(g_slice_polylines);
+        g_slice_points = NULL; g_slice_polylines = NULL; return;
+    }
+    memset(table, 0xFF, table_size * sizeof(int)); // -1 marks an empty slot
+    int joint_count = 0;
+    for (int s = 0; s < segment_count; ++s) {
+        int a = slice_joint(joints, &joint_count, table, table_size, ends[s * 2].key, ends[s * 2].point);
+        int b = slice_joint(joints, &joint_count, table, table_size, ends[s * 2 + 1].key, ends[s * 2 + 1].point);
+        if (a != b) { slice_link(&joints[a], b); slice_link(&joints[b], a); }
+    }
+    int point_count = 0;
+    g_slice_polylines[0] = 0;
+    for (int j = 0; j < joint_count; ++j) { if (!visited[j] && joints[j].link[1] < 0) slice_walk(joints, visited, j, &point_count); } // Open ends first
+    for (int j = 0; j < joint_count; ++j) { if (!visited[j]) slice_walk(joints, visited, j, &point_count); }
+    free(ends); free(table); free(joints); free(visited);
+    app_log(false, "DEBUG", "Slice at z %g: %d of %d faces cut, %d polylines (%d closed) in %.2f ms.", z / g_model_scale + g_model_center.z, segment_count,
+        visited_faces, g_num_slice_polylines, g_num_slice_closed, (al_get_time() - start_time) * 1e3);
+}
+
+// Moves the plane by steps SLICE_STEPS fractions of the Z range and recomputes the outline.
+static void move_slice(int steps) {
+    float step = (g_slice_zmax - g_slice_zmin) / SLICE_STEPS;
+    g_slice_z = fminf(g_slice_zmax, fmaxf(g_slice_zmin, g_slice_z + steps * step));
+    update_slice();
+}
+
+// Draws the outline on top of the frame: closed loops green, open polylines orange.
+static void draw_slice_overlay(const ViewTransform* view) {
+    if (!g_show_slice || !g_slice_points || g_num_slice_polylines == 0) return;
+    int segment_count = g_slice_polylines[g_num_slice_polylines] - g_num_slice_polylines;
+    ALLEGRO_VERTEX* lines = (ALLEGRO_VERTEX*)malloc((size_t)segment_count * 2 * sizeof(ALLEGRO_VERTEX));
+    if (!lines) return;
+    int n = 0;
+    for (int i = 0; i < g_num_slice_polylines; ++i) {
+        int first = g_slice_polylines[i], end = g_slice_polylines[i + 1];
+        Point3D a = g_slice_points[first], b = g_slice_points[end - 1];
+        bool closed = a.x == b.x && a.y == b.y && end - first > 2;
+        ALLEGRO_COLOR color = closed ? al_map_rgb(60, 255, 60) : al_map_rgb(255, 160, 0);
+        Point3D prev = view_project(view, a);
+        for (int k = first + 1; k < end; ++k) {
+            Point3D p = view_project(view, g_slice_points[k]);
+            lines[n++] = (ALLEGRO_VERTEX){ prev.x + SCREEN_W / 2.0f, -prev.y + SCREEN_H / 2.0f, 0, 0, 0, color };
+            lines[n++] = (ALLEGRO_VERTEX){ p.x + SCREEN_W / 2.0f, -p.y + SCREEN_H / 2.0f, 0, 0, 0, color };
+            prev = p;
+        }
+    }
+    draw_line_list(lines, n);
+    free(lines);
+}
+
+int main(int argc, char** argv) {
+    g_log_file = fopen(LOG_FILE, "w");
+    if (!g_log_file) { app_log(true, "FATAL", "Could not open log file %s. Exiting.", LOG_FILE); return 1; }
+    g_orientation = quaternion_identity();
+
+    ALLEGRO_DISPLAY* display = NULL; ALLEGRO_EVENT_QUEUE* event_queue = NULL;
+    ALLEGRO_TIMER* timer = NULL; ALLEGRO_FONT* font = NULL;
+
+    const char* stl_filename = NULL; const char* profile_csv_path = NULL; bool allow_simd = true;
+    bool benchmark = false; BenchmarkOptions benchmark_options = { BENCHMARK_DEFAULT_FRAMES, 1, NULL, NULL };
+    bool stats = false; StatsOptions stats_options = { STATS_FORMAT_JSON, NULL, true };
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--weld") == 0) { g_weld_vertices = true; }
+        else if (strcmp(argv[i], "--no-simd") == 0) { allow_simd = false; }
+        else if (strcmp(argv[i], "--cache") == 0) { g_use_mesh_cache = true; }
+        else if (strcmp(argv[i], "--compact") == 0) { g_compact_positions = g_weld_vertices = true; } // Quantization only pays off on shared vertices
+        else if (strncmp(argv[i], "--profile-csv=", 14) == 0) { profile_csv_path = argv[i] + 14; }
+        else if (strcmp(argv[i], "--benchmark") == 0) { benchmark = true; g_log_console_stderr = true; }
+        else if (strncmp(argv[i], "--benchmark-frames=", 19) == 0) { benchmark_options.frames = atoi(argv[i] + 19); }
+        else if (strncmp(argv[i], "--benchmark-seed=", 17) == 0) { benchmark_options.seed = (uint32_t)strtoul(argv[i] + 17, NULL, 10); }
+        else if (strncmp(argv[i], "--benchmark-json=", 17) == 0) { benchmark_options.json_path = argv[i] + 17; }
+        else if (strcmp(argv[i], "--stats") == 0) { stats = true; g_log_console_stderr = true; }
+        else if (strncmp(argv[i], "--stats-out=", 12) == 0) { stats_options.out_path = argv[i] + 12; }
+        else if (strncmp(argv[i], "--stats-format=", 15) == 0) {
+            if (strcmp(argv[i] + 15, "json") == 0) stats_options.format = STATS_FORMAT_JSON;
+            else if (strcmp(argv[i] + 15, "csv") == 0) stats_options.format = STATS_FORMAT_CSV;
+            else app_log(true, "WARN", "Unknown --stats-format '%s'; expected json or csv.", argv[i] + 15);
+        }
+        else if (strcmp(argv[i], "--perspective") == 0) { g_camera.perspective = true; }
+        else if (strncmp(argv[i], "--zoom=", 7) == 0) {
+            float zoom = strtof(argv[i] + 7, NULL);
+            if (!(zoom >= CAMERA_MIN_ZOOM && zoom <= CAMERA_MAX_ZOOM)) app_log(true, "WARN", "--zoom must be between %g and %g; keeping %g.", CAMERA_MIN_ZOOM, CAMERA_MAX_ZOOM, g_camera.zoom);
+            else g_camera.zoom = zoom;
+        }
+        else if (strncmp(argv[i], "--log-level=", 12) == 0) {
+            int level = log_level_from_name(argv[i] + 12);
+            if (level < 0) app_log(true, "WARN", "Unknown log level '%s'; expected debug, info, warn or error.", argv[i] + 12);
+            else g_log_level = level;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0) { app_log(true, "WARN", "Ignoring unknown option '%s'.", argv[i]); }
+        else if (!stl_filename) {
+            stl_filename = argv[i];
+            app_log(false, "DEBUG", "STL filename from args: %s", stl_filename);
+        }
+    }
+    app_log(true, "INFO", "Application started. Log file: %s", LOG_FILE);
+    if (stats) { // Every non-option argument is an input, so the default model path does not apply
+        stats_options.allow_simd = allow_simd;
+        int exit_code = run_stats(argc, argv, &stats_options);
+        app_log(true, "INFO", "Stats finished.");
+        close_log();
+        return exit_code;
+    }
+    if (!stl_filename) {
+        stl_filename = DEFAULT_STL_PATH;
+        app_log(true, "INFO", "No command line argument for STL file. Using default: %s", stl_filename);
+    }
+
+    select_transform_kernel(allow_simd);
+
+    if (benchmark) {
+        if (benchmark_options.frames < 1) { app_log(true, "WARN", "--benchmark-frames must be positive; using %d.", BENCHMARK_DEFAULT_FRAMES); benchmark_options.frames = BENCHMARK_DEFAULT_FRAMES; }
+        benchmark_options.profile_csv_path = profile_csv_path;
+        int exit_code = run_benchmark(stl_filename, &benchmark_options);
+        app_log(true, "INFO", "Benchmark finished.");
+        close_log();
+        return exit_code;
+    }
+
+    if (init_allegro() != 0) { close_log(); return -1; }
+    log_start_writer();
+    worker_pool_init(); // Before the loading thread, which shares the pool with the render loop
+    if (profile_csv_path) profile_open_csv(profile_csv_path); // Failure only loses the CSV
+    display = al_create_display(SCREEN_W, SCREEN_H);
+    if (!display) { app_log(true, "ERROR", "Failed to create display!"); /* full cleanup */ close_log(); return -1; }
+    timer = al_create_timer(1.0 / FPS);
+    if (!timer) { app_log(true, "ERROR", "Failed to create timer!"); /* full cleanup */ close_log(); return -1; }
+    event_queue = al_create_event_queue();
+    if (!event_queue) { app_log(true, "ERROR", "Failed to create event_queue!"); /* full cleanup */ close_log(); return -1; }
+    font = al_load_ttf_font("arial.ttf", 18, 0);
+    if (!font) { app_log(true, "WARN", "Failed to load 'arial.ttf'. Trying built-in font."); font = al_create_builtin_font(); }
+    if (!font) { app_log(true, "ERROR", "Failed to load any font."); }
+    else { app_log(false, "DEBUG", "Font loaded."); }
+    al_register_event_source(event_queue, al_get_display_event_source(display));
+    al_register_event_source(event_queue, al_get_timer_event_source(timer));
+    al_register_event_source(event_queue, al_get_keyboard_event_source());
+    al_register_event_source(event_queue, al_get_mouse_event_source());
+
+    if (!stream_start(stl_filename)) { app_log(true, "INFO", "Exiting due to STL load failure."); /* full cleanup */ close_log(); return -1; }
+    bool model_shown = !stream_loading(); // A failed first load still exits, as it did before loading moved to a thread
+    int exit_code = 0;
+
+    bool redraw = true; al_start_timer(timer); bool running = true;
+    app_log(false, "DEBUG", "Entering main loop.");
+
+    while (running) {
+        ALLEGRO_EVENT ev;
+        al_wait_for_event(event_queue, &ev);
+
+        if (ev.type == ALLEGRO_EVENT_TIMER) {
+            redraw = true;
+            if (stream_loading()) {
+                bool preview_changed = false;
+                StreamStatus status = stream_poll(&preview_changed);
+                if (preview_changed || status != STREAM_LOADING) invalidate_frame_cache();
+                if (status == STREAM_LOADED) model_shown = true;
+                else if (status == STREAM_CANCELLED) model_shown = true; // Stay open with an empty model; F5 loads again
+                else if (status == STREAM_FAILED && !model_shown) { app_log(true, "INFO", "Exiting due to STL load failure."); exit_code = -1; running = false; }
+                else if (status == STREAM_FAILED) app_log(true, "WARN", "Reload of %s failed; showing an empty model.", stl_filename);
+            }
+        }
+        else if (ev.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
+            running = false;
+        }
+        else if (ev.type == ALLEGRO_EVENT_DISPLAY_RESIZE) {
+            al_acknowledge_resize(display); invalidate_frame_cache(); redraw = true;
+        }
+        else if (ev.type == ALLEGRO_EVENT_DISPLAY_FOUND || ev.type == ALLEGRO_EVENT_DISPLAY_SWITCH_IN) {
+            invalidate_frame_cache(); redraw = true; // Video bitmap contents may not have survived
+        }
+        else if (ev.type == ALLEGRO_EVENT_DISPLAY_EXPOSE) {
+            redraw = true;
+        }
+        else if (ev.type == ALLEGRO_EVENT_KEY_DOWN) {
+            if (ev.keyboard.keycode == ALLEGRO_KEY_ESCAPE) { running = false; }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_C) { stream_cancel(); }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_T) { g_profiler.show_hud = !g_profiler.show_hud; redraw = true; }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_R) {
+                g_render_mode = g_render_mode == RENDER_MODE_ZBUFFER ? RENDER_MODE_PAINTER : RENDER_MODE_ZBUFFER;
+                app_log(false, "DEBUG", "Render mode: %s", g_render_mode == RENDER_MODE_ZBUFFER ? "Z-buffer" : "Painter");
+                invalidate_frame_cache(); redraw = true;
+            }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_B) {
+                g_backface_culling = !g_backface_culling;
+                app_log(false, "DEBUG", "Back-face culling %s", g_backface_culling ? "enabled" : "disabled");
+                invalidate_frame_cache(); redraw = true;
+            }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_P) {
+                g_camera.perspective = !g_camera.perspective;
+                app_log(false, "DEBUG", "Projection: %s", g_camera.perspective ? "perspective" : "orthographic");
+                invalidate_frame_cache(); redraw = true;
+            }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_V && !stream_loading()) {
+                if (!g_mesh_validated) g_show_validation = validate_mesh();
+                else g_show_validation = !g_show_validation;
+                invalidate_frame_cache(); redraw = true;
+            }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_S && !stream_loading()) {
+                if (!g_slice_nodes) {
+                    g_show_slice = build_slice_index();
+                    g_slice_z = 0.5f * (g_slice_zmin + g_slice_zmax);
+                    update_slice();
+                }
+                else g_show_slice = !g_show_slice;
+                invalidate_frame_cache(); redraw = true;
+            }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_HOME) { camera_reset(); invalidate_frame_cache(); redraw = true; }
+            else if (ev.keyboard.keycode == ALLEGRO_KEY_F5) {
+                app_log(true, "INFO", "Reloading %s", stl_filename);
+                stream_release(); // Abandons a load that is still running
+                lod_release();
+                cleanup_model_data();
+                model_shown = true;
+                if (!stream_start(stl_filename)) app_log(true, "WARN", "Reload of %s failed; showing an empty model.", stl_filename);
+                invalidate_frame_cache(); redraw = true;
+            }
+        }
+        else if (ev.type == ALLEGRO_EVENT_KEY_CHAR) { // Repeats while held, so the slice plane scrubs
+            if ((ev.keyboard.keycode == ALLEGRO_KEY_PGUP || ev.keyboard.keycode == ALLEGRO_KEY_PGDN) && g_show_slice && !stream_loading()) {
+                move_slice(ev.keyboard.keycode == ALLEGRO_KEY_PGUP ? 1 : -1);
+                invalidate_frame_cache(); redraw = true;
+            }
+        }
+        else if (ev.type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN) {
+            if (ev.mouse.button == 1) { is_dragging = true; last_mouse_x = press_mouse_x = ev.mouse.x; last_mouse_y = press_mouse_y = ev.mouse.y; }
+            else if (ev.mouse.button == 2) { is_panning = true; last_mouse_x = ev.mouse.x; last_mouse_y = ev.mouse.y; }
+        }
+        else if (ev.type == ALLEGRO_EVENT_MOUSE_BUTTON_UP) {
+            if (ev.mouse.button == 1) {
+                is_dragging = false; invalidate_frame_cache(); redraw = true; // Back to full resolution
+                if (abs(ev.mouse.x - press_mouse_x) + abs(ev.mouse.y - press_mouse_y) <= PICK_CLICK_SLOP && !stream_loading()) pick_and_report(ev.mouse.x, ev.mouse.y);
+            }
+            else if (ev.mouse.button == 2) { is_panning = false; invalidate_frame_cache(); redraw = true; }
+        }
+        else if (ev.type == ALLEGRO_EVENT_MOUSE_AXES || ev.type == ALLEGRO_EVENT_MOUSE_WARPED) {
+            if (ev.mouse.dz != 0) {
+                camera_zoom_at(g_orientation, ev.mouse.x, ev.mouse.y, powf(CAMERA_WHEEL_STEP, (float)ev.mouse.dz));
+                invalidate_frame_cache(); redraw = true;
+            }
+            if (is_panning && !is_dragging) {
+                camera_pan(g_orientation, ev.mouse.x - last_mouse_x, ev.mouse.y - last_mouse_y);
+                last_mouse_x = ev.mouse.x; last_mouse_y = ev.mouse.y; invalidate_frame_cache(); redraw = true;
+            }
+            else if (is_dragging) {
+                int mouse_dx = ev.mouse.x - last_mouse_x; int mouse_dy = ev.mouse.y - last_mouse_y;
+                float delta_angle_y_view = -mouse_dx * MOUSE_SENSITIVITY; Point3D view_up_axis = { 0, 1, 0 };
+                Quaternion q_rot_around_view_y = quaternion_from_axis_angle(view_up_axis, delta_angle_y_view);
+                float delta_angle_x_view = -mouse_dy * MOUSE_SENSITIVITY; Point3D view_right_axis = { 1, 0, 0 };
+                Quaternion q_rot_around_view_x = quaternion_from_axis_angle(view_right_axis, delta_angle_x_view);
+                Quaternion screen_space_delta_rotation = quaternion_multiply(q_rot_around_view_y, q_rot_around_view_x);
+                g_orientation = quaternion_multiply(screen_space_delta_rotation, g_orientation);
+                g_orientation = quaternion_normalize(g_orientation);
+                last_mouse_x = ev.mouse.x; last_mouse_y = ev.mouse.y; invalidate_frame_cache(); redraw = true;
+            }
+        }
+
+        if (redraw && al_is_event_queue_empty(event_queue)) {
+            redraw = false;
+            bool loading = stream_loading(); // While loading, only the preview may be touched; the globals belong to the loader
+            RenderMesh mesh = loading ? g_stream.preview : full_render_mesh();
+            if (mesh.num_faces == 0 || mesh.num_vertices == 0) {
+                al_clear_to_color(al_map_rgb(30, 30, 30));
+                if (loading) draw_load_progress(font);
+                else if (font) al_draw_text(font, al_map_rgb(255, 0, 0), SCREEN_W / 2.f, SCREEN_H / 2.f, ALLEGRO_ALIGN_CENTER, "Model empty.");
+                al_flip_display(); continue;
+            }
+            bool using_proxy = !loading && (is_dragging || is_panning) && lod_drag_mesh(&mesh);
+            profile_begin_frame();
+            bool cached = ensure_frame_cache(display);
+            bool rendered = !cached || g_frame_cache_dirty;
+            if (rendered) {
+                if (cached) al_set_target_bitmap(g_frame_cache);
+                al_clear_to_color(al_map_rgb(30, 30, 30));
+
+                ViewTransform view = camera_view(g_orientation);
+
+                double transform_start = al_get_time();
+                transform_render_mesh(&view, &mesh);
+                profile_add(PROFILE_TRANSFORM, transform_start);
+
+                if (g_render_mode == RENDER_MODE_ZBUFFER) render_model_zbuffer(&mesh, &view);
+                else render_model_painter(&mesh, &view);
+                if (!loading) { draw_validation_overlay(&view); draw_slice_overlay(&view); draw_picked_face(&view); }
+
+                if (cached) { al_set_target_backbuffer(display); g_frame_cache_dirty = false; }
+            }
+            if (cached) al_draw_bitmap(g_frame_cache, 0, 0, 0);
+
+            if (font) {
+                char info_text[192];
+                snprintf(info_text, sizeof(info_text), "Faces: %d%s. Verts: %d. Gradient. %s (R). Culling %s (B). %s %.2gx (P). ESC exit.", mesh.num_faces,
+                    loading ? " (loading)" : using_proxy ? " (drag proxy)" : "", mesh.num_vertices, g_render_mode == RENDER_MODE_ZBUFFER ? "Z-buffer" : "Painter", g_backface_culling ? "on" : "off",
+                    g_camera.perspective ? "Persp" : "Ortho", g_camera.zoom);
+                al_draw_text(font, al_map_rgb(255, 255, 255), 10, 10, 0, info_text);
+                if (!loading && g_picked_face >= 0) {
+                    snprintf(info_text, sizeof(info_text), "Picked face %d at (%g, %g, %g), area %g (model units).", g_picked_face,
+                        g_picked_point.x, g_picked_point.y, g_picked_point.z, g_picked_area);
+                    al_draw_text(font, al_map_rgb(255, 255, 0), 10, 30, 0, info_text);
+                }
+                if (!loading && g_show_validation && g_mesh_validated) {
+                    snprintf(info_text, sizeof(info_text), "Validation (V): %lld open, %lld non-manifold, %lld flipped edges; %lld duplicate, %lld degenerate faces.",
+                        g_validation.open_edges, g_validation.non_manifold_edges, g_validation.winding_edges, g_validation.duplicate_faces, g_validation.degenerate_faces);
+                    al_draw_text(font, al_map_rgb(255, 120, 120), 10, SCREEN_H - 25, 0, info_text);
+                }
+                if (!loading && g_show_slice) {
+                    snprintf(info_text, sizeof(info_text), "Slice z = %g (PgUp/PgDn, S): %d closed, %d open outlines.", g_slice_z / g_model_scale + g_model_center.z,
+                        g_num_slice_closed, g_num_slice_polylines - g_num_slice_closed);
+                    al_draw_text(font, al_map_rgb(60, 255, 60), 10, SCREEN_H - 45, 0, info_text);
+                }
+                draw_profile_hud(font, 55);
+            }
+            if (loading) draw_load_progress(font);
+            double flip_start = al_get_time();
+            al_flip_display();
+            profile_add(PROFILE_FLIP, flip_start);
+            profile_end_frame(rendered, g_render_mode == RENDER_MODE_ZBUFFER ? "zbuffer" : "painter", mesh.num_faces);
+        }
+    }
+    app_log(false, "DEBUG", "Exiting main loop.");
+
+    // No need to free draw_buffer as it's not used in the final drawing loop
+
+    app_log(false, "DEBUG", "Starting cleanup sequence.");
+    stream_release();
+    lod_release();
+    cleanup_model_data();
+    rasterizer_release();
+    release_frame_cache();
+    worker_pool_shutdown();
+    if (font) al_destroy_font(font); if (event_queue) al_destroy_event_queue(event_queue);
+    if (timer) al_destroy_timer(timer); if (display) al_destroy_display(display);
+    al_shutdown_ttf_addon(); al_shutdown_font_addon(); al_shutdown_primitives_addon();
+    al_uninstall_mouse(); al_uninstall_keyboard();
+    profile_close();
+    app_log(true, "INFO", "Application terminated normally.");
+    close_log();
+    return exit_code;
 }
\ No newline at end of file